@@ -0,0 +1,337 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <cstdio>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdlib>
+#include <csignal>
+#include <arpa/inet.h>
+#include <byteswap.h>
+#include <ctime>
+#include <cinttypes>
+#include <netdb.h>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "err.h"
+#include "datagram.h"
+#include "budget.h"
+#include "clients.h"
+
+// Load generator and benchmark of the relay server: simulates subscribers
+// and senders from one process and measures what the server delivers.
+// Every subscriber is a socket bound to its own port on the loopback,
+// registered by sending one datagram. Senders send datagrams at a fixed
+// rate; the character of every datagram identifies it, so that its delivery
+// latency can be measured (the server overwrites the timestamp). There are
+// only ID_COUNT ids, so an id is reused only after all subscribers got its
+// datagram or SETTLE_US passed since it was sent (later copies are taken as
+// lost, like at the end of the run). While the oldest id isn't free, sends
+// are skipped instead of timing late copies against a newer datagram.
+
+#define PORT_DEFAULT 20160
+#define DEFAULT_SUBSCRIBERS 1000
+#define DEFAULT_SENDERS 1
+#define DEFAULT_RATE 100
+#define DEFAULT_DURATION 10
+// Subscribers register only once, so the whole run (with SETTLE_US before
+// and after it) has to end before the server forgets them; sending
+// registrations again would add to the measured traffic.
+#define MAX_DURATION 100
+// Character of registration datagrams, others are datagram ids.
+#define REGISTER_CHAR ((char) 0xff)
+#define ID_COUNT 255
+// Time for registrations to be relayed and late datagrams to arrive,
+// also after which a datagram not delivered to everyone frees its id.
+#define SETTLE_US 1000000
+static_assert(MAX_DURATION + 2 * SETTLE_US / 1000000 < CLIENT_TIMEOUT,
+              "subscribers would expire during the run");
+#define RECV_BATCH 16
+#define MAX_EVENTS 256
+#define USAGE "Usage: %s [-n subscribers] [-s senders] " \
+              "[-r datagrams_per_sec_per_sender] [-d seconds] host [port]"
+
+bool finish = false;
+
+static void catch_int(int sig) {
+  finish = true;
+  fprintf(stderr, "\nSignal %d catched, closing.\n", sig);
+}
+
+uint16_t parse_port(const char *str) {
+  long port_long = strtol(str, NULL, 10);
+  if (errno == ERANGE || port_long <= 0 || port_long > UINT16_MAX)
+    fatal("\"%s\" is not a valid and positive uint16_t", str);
+  return (uint16_t) port_long;
+}
+
+long parse_positive(const char *str, const char *what) {
+  char *end;
+  errno = 0;
+  long value = strtol(str, &end, 10);
+  if (errno == ERANGE || *end != 0 || value <= 0)
+    fatal("\"%s\" is not a valid %s", str, what);
+  return value;
+}
+
+struct stats_t {
+  stats_t() : sent(0), skipped(0), received(0), received_bytes(0) {}
+
+  uint64_t sent;           // datagrams sent by senders
+  uint64_t skipped;        // sends skipped with all ids in flight
+  uint64_t received;       // copies of them received by subscribers
+  uint64_t received_bytes;
+  std::vector<uint32_t> latencies_us;
+};
+
+// Datagram sent under an id: when, and how many subscribers haven't got it.
+struct in_flight_t {
+  uint64_t sent_us;  // 0 if the id wasn't used yet
+  long pending;
+};
+
+// Receives everything waiting on a subscriber socket. Only datagrams
+// of senders are counted (while measuring), registrations are dropped.
+void drain(int sock, bool measuring, in_flight_t *in_flight,
+           std::vector<char> &buffers, stats_t &stats) {
+  struct mmsghdr msgs[RECV_BATCH];
+  struct iovec iovecs[RECV_BATCH];
+  while (true) {
+    for (size_t i = 0; i < RECV_BATCH; ++i) {
+      iovecs[i].iov_base = &buffers[i * sizeof(datagram_with_file_t)];
+      iovecs[i].iov_len = sizeof(datagram_with_file_t);
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_iov = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count = recvmmsg(sock, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    checkerr(count, "recvmmsg");
+    uint64_t now_us = monotonic_us();
+    for (int i = 0; i < count; ++i) {
+      char c = ((const char *) iovecs[i].iov_base)[sizeof(uint64_t)];
+      if (!measuring || c == REGISTER_CHAR
+          || msgs[i].msg_len < HEADER_LENGTH)
+        continue;
+      if ((unsigned char) c >= ID_COUNT)
+        continue;
+      in_flight_t &flight = in_flight[(unsigned char) c];
+      if (flight.sent_us == 0)
+        continue;
+      if (flight.pending > 0)
+        --flight.pending;
+      ++stats.received;
+      stats.received_bytes += msgs[i].msg_len;
+      stats.latencies_us.push_back((uint32_t) (now_us - flight.sent_us));
+    }
+    if (count < RECV_BATCH)
+      return;
+  }
+}
+
+void send_datagram(int sock, const struct sockaddr_in &server, char c) {
+  char buffer[HEADER_LENGTH];
+  uint64_t timestamp = bswap_64((uint64_t) time(NULL));
+  memcpy(buffer, &timestamp, sizeof(timestamp));
+  buffer[sizeof(uint64_t)] = c;
+  ssize_t ret = sendto(sock, buffer, sizeof(buffer), 0,
+                       (const struct sockaddr *) &server, sizeof(server));
+  if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    syserr("sendto");
+}
+
+int open_socket(int epoll_fd) {
+  int sock = socket(PF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  checkerr(sock, "socket");
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+  checkerr(bind(sock, (struct sockaddr *) &address, sizeof(address)), "bind");
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = sock;
+  checkerr(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event), "epoll_ctl");
+  return sock;
+}
+
+uint32_t percentile(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  size_t i = (size_t) (p * (double) (sorted.size() - 1));
+  return sorted[i];
+}
+
+int main(int argc, char *argv[]) {
+  long subscribers = DEFAULT_SUBSCRIBERS;
+  long senders = DEFAULT_SENDERS;
+  long rate = DEFAULT_RATE;
+  long duration = DEFAULT_DURATION;
+  int option;
+  while ((option = getopt(argc, argv, "d:n:r:s:")) != -1) {
+    switch (option) {
+      case 'd':
+        duration = parse_positive(optarg, "duration");
+        if (duration > MAX_DURATION)
+          fatal("Duration can be at most %d seconds", MAX_DURATION);
+        break;
+      case 'n':
+        subscribers = parse_positive(optarg, "number of subscribers");
+        break;
+      case 'r':
+        rate = parse_positive(optarg, "rate");
+        break;
+      case 's':
+        senders = parse_positive(optarg, "number of senders");
+        break;
+      default:
+        fatal(USAGE, argv[0]);
+    }
+  }
+  // Positional arguments are shifted to argv[1], argv[0] is lost.
+  const char *program = argv[0];
+  argc -= optind - 1;
+  argv += optind - 1;
+  if (argc < 2 || argc > 3)
+    fatal(USAGE, program);
+
+  uint16_t port = PORT_DEFAULT;
+  if (argc == 3)
+    port = parse_port(argv[2]);
+  char port_string[10];
+  sprintf(port_string, "%d", port);
+
+  struct addrinfo addr_hints;
+  struct addrinfo *addr_result;
+  memset(&addr_hints, 0, sizeof(struct addrinfo));
+  addr_hints.ai_family = AF_INET;
+  addr_hints.ai_socktype = SOCK_DGRAM;
+  addr_hints.ai_protocol = IPPROTO_UDP;
+  if (getaddrinfo(argv[1], port_string, &addr_hints, &addr_result) != 0)
+    syserr("getaddrinfo");
+  struct sockaddr_in server;
+  memcpy(&server, addr_result->ai_addr, sizeof(server));
+  freeaddrinfo(addr_result);
+
+  // Every simulated client needs its own socket.
+  struct rlimit limit;
+  checkerr(getrlimit(RLIMIT_NOFILE, &limit), "getrlimit");
+  limit.rlim_cur = limit.rlim_max;
+  checkerr(setrlimit(RLIMIT_NOFILE, &limit), "setrlimit");
+  if ((rlim_t) (subscribers + senders + 16) > limit.rlim_cur)
+    fatal("Too many sockets needed, the limit is %lu",
+          (unsigned long) limit.rlim_cur);
+
+  if (signal(SIGINT, catch_int) == SIG_ERR)
+    syserr("Unable to change signal handler");
+
+  int epoll_fd = epoll_create1(0);
+  checkerr(epoll_fd, "epoll_create1");
+  // Subscribers' sockets are registered with the server; senders are
+  // clients too, datagrams relayed to them are drained and not counted.
+  std::vector<int> subscriber_socks, sender_socks;
+  std::vector<bool> is_subscriber;
+  for (long i = 0; i < subscribers; ++i) {
+    int sock = open_socket(epoll_fd);
+    subscriber_socks.push_back(sock);
+    if ((size_t) sock >= is_subscriber.size())
+      is_subscriber.resize(sock + 1);
+    is_subscriber[sock] = true;
+    send_datagram(sock, server, REGISTER_CHAR);
+  }
+  for (long i = 0; i < senders; ++i)
+    sender_socks.push_back(open_socket(epoll_fd));
+  fprintf(stderr, "Registered %ld subscribers\n", subscribers);
+
+  std::vector<char> buffers(RECV_BATCH * sizeof(datagram_with_file_t));
+  in_flight_t in_flight[ID_COUNT];
+  memset(in_flight, 0, sizeof(in_flight));
+  stats_t stats;
+  struct epoll_event events[MAX_EVENTS];
+
+  uint64_t start_us = monotonic_us() + SETTLE_US;
+  uint64_t end_us = start_us + (uint64_t) duration * 1000000;
+  uint64_t stop_us = end_us + SETTLE_US;
+  uint64_t interval_us = 1000000 / (uint64_t) (rate * senders);
+  if (interval_us == 0)
+    interval_us = 1;
+  uint64_t next_send_us = start_us;
+  size_t next_sender = 0;
+  unsigned next_id = 0;
+
+  while (!finish) {
+    uint64_t now_us = monotonic_us();
+    if (now_us >= stop_us)
+      break;
+    bool measuring = now_us >= start_us;
+
+    while (now_us < end_us && now_us >= next_send_us) {
+      next_send_us += interval_us;
+      // Ids are used in order, so this one was sent the longest ago.
+      in_flight_t &flight = in_flight[next_id];
+      if (flight.pending > 0 && now_us - flight.sent_us < SETTLE_US) {
+        ++stats.skipped;
+        continue;
+      }
+      flight.sent_us = monotonic_us();
+      flight.pending = subscribers;
+      send_datagram(sender_socks[next_sender], server, (char) next_id);
+      ++stats.sent;
+      next_id = (next_id + 1) % ID_COUNT;
+      next_sender = (next_sender + 1) % sender_socks.size();
+    }
+
+    uint64_t wake_us = now_us < end_us ? next_send_us : stop_us;
+    int timeout_ms = wake_us > now_us ? (int) ((wake_us - now_us) / 1000) : 0;
+    int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (count < 0 && errno == EINTR)
+      continue;
+    checkerr(count, "epoll_wait");
+    for (int i = 0; i < count; ++i) {
+      int sock = events[i].data.fd;
+      bool counted = measuring && (size_t) sock < is_subscriber.size()
+                     && is_subscriber[sock];
+      drain(sock, counted, in_flight, buffers, stats);
+    }
+  }
+
+  // Rates are per second of sending, deliveries late by less than SETTLE_US
+  // are counted too.
+  double seconds = (double) duration;
+  uint64_t expected = stats.sent * (uint64_t) subscribers;
+  std::sort(stats.latencies_us.begin(), stats.latencies_us.end());
+
+  printf("subscribers %ld, senders %ld, %ld datagrams/s each, %ld s\n",
+         subscribers, senders, rate, duration);
+  printf("sent %" PRIu64 ", delivered %" PRIu64 " of %" PRIu64
+         " (loss %.3f%%)\n", stats.sent, stats.received, expected,
+         expected == 0 ? 0.0
+             : 100.0 * (double) (expected - std::min(expected, stats.received))
+               / (double) expected);
+  if (stats.skipped > 0)
+    printf("skipped %" PRIu64 " sends, %d datagrams were in flight\n",
+           stats.skipped, ID_COUNT);
+  printf("fan-out %.0f datagrams/s, %.0f bytes/s\n",
+         (double) stats.received / seconds,
+         (double) stats.received_bytes / seconds);
+  printf("latency us: p50 %" PRIu32 ", p90 %" PRIu32 ", p99 %" PRIu32
+         ", p99.9 %" PRIu32 ", max %" PRIu32 "\n",
+         percentile(stats.latencies_us, 0.5),
+         percentile(stats.latencies_us, 0.9),
+         percentile(stats.latencies_us, 0.99),
+         percentile(stats.latencies_us, 0.999),
+         percentile(stats.latencies_us, 1.0));
+
+  for (int sock : subscriber_socks)
+    close(sock);
+  for (int sock : sender_socks)
+    close(sock);
+  close(epoll_fd);
+  return 0;
+}
@@ -0,0 +1,118 @@
+#ifndef ZADANIE1_BUDGET_H
+#define ZADANIE1_BUDGET_H
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+#include <netinet/in.h>
+
+// Number of per-source buckets, must be a power of two.
+#define SOURCE_BUCKETS 4096
+
+// Returns monotonic time in microseconds.
+uint64_t monotonic_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000 + ((uint64_t) ts.tv_nsec) / 1000;
+}
+
+// Token bucket refilled with rate bytes per second, holding at most
+// capacity tokens (by default one second worth). A datagram is let through
+// while the bucket isn't in debt, even if it costs more than the bucket
+// holds, so huge fan-outs aren't starved forever and the long-term rate
+// still holds.
+struct token_bucket_t {
+  double tokens;
+  uint64_t last_us;
+
+  void refill(uint64_t rate, uint64_t now_us, double capacity) {
+    tokens += (double) rate * (double) (now_us - last_us) / 1e6;
+    if (tokens > capacity)
+      tokens = capacity;
+    last_us = now_us;
+  }
+
+  void refill(uint64_t rate, uint64_t now_us) {
+    refill(rate, now_us, (double) rate);
+  }
+};
+
+// Limits how many bytes the server sends on behalf of received datagrams,
+// both in total and per source address, so that a small (possibly spoofed)
+// datagram can't make the server flood the network. A rate of 0 means
+// no limit. Sources are hashed into a fixed table, a source taking over
+// a slot of another one gets a full bucket.
+class egress_budget_t {
+ public:
+  egress_budget_t(uint64_t global_rate, uint64_t source_rate)
+      : global_rate(global_rate), source_rate(source_rate),
+        sources(source_rate > 0 ? SOURCE_BUCKETS : 0),
+        shed_datagrams(0), shed_bytes(0) {
+    global.tokens = (double) global_rate;
+    global.last_us = monotonic_us();
+  }
+
+  // Returns true if the given cost in bytes fits in the budgets (taking
+  // the tokens), false if the datagram should be dropped. Datagrams which
+  // aren't charged to their source only take from the total budget.
+  bool allow(in_addr_t source, uint64_t cost, uint64_t now_us,
+             bool per_source = true) {
+    source_t *entry = NULL;
+    if (source_rate > 0 && per_source) {
+      entry = &sources[(source * 2654435761U) >> 20 & (SOURCE_BUCKETS - 1)];
+      if (entry->addr != source || entry->bucket.last_us == 0) {
+        entry->addr = source;
+        entry->bucket.tokens = (double) source_rate;
+        entry->bucket.last_us = now_us;
+      }
+      entry->bucket.refill(source_rate, now_us);
+      if (entry->bucket.tokens < 0)
+        return shed(cost);
+    }
+    if (global_rate > 0) {
+      global.refill(global_rate, now_us);
+      if (global.tokens < 0)
+        return shed(cost);
+      global.tokens -= (double) cost;
+    }
+    if (entry != NULL)
+      entry->bucket.tokens -= (double) cost;
+    return true;
+  }
+
+  bool enabled() const {
+    return global_rate > 0 || source_rate > 0;
+  }
+
+  uint64_t shed_datagrams_count() const {
+    return shed_datagrams;
+  }
+
+  uint64_t shed_bytes_count() const {
+    return shed_bytes;
+  }
+
+ private:
+  struct source_t {
+    source_t() : addr(0) {
+      bucket.tokens = 0;
+      bucket.last_us = 0;
+    }
+
+    in_addr_t addr;
+    token_bucket_t bucket;
+  };
+
+  bool shed(uint64_t cost) {
+    ++shed_datagrams;
+    shed_bytes += cost;
+    return false;
+  }
+
+  uint64_t global_rate, source_rate;
+  token_bucket_t global;
+  std::vector<source_t> sources;
+  uint64_t shed_datagrams, shed_bytes;
+};
+
+#endif //ZADANIE1_BUDGET_H
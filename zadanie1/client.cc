@@ -12,11 +12,23 @@
 #include <ctime>
 #include <cinttypes>
 #include <netdb.h>
+#include <cstring>
+#include <vector>
 
 #include "err.h"
 #include "datagram.h"
+#include "reassembly.h"
+#include "output.h"
 
 #define PORT_DEFAULT 20160
+#define MULTICAST_PORT_DEFAULT 20161
+// Number of datagrams received with one recvmmsg call.
+#define RECV_BATCH 32
+// Maximum number of datagrams received from one socket before they
+// are written out, so that output isn't delayed too much.
+#define RECV_BUDGET 1024
+#define USAGE "Usage: %s [-s] [-m multicast_group] [-M multicast_port] " \
+              "timestamp c host [port]"
 
 bool finish = false;
 
@@ -25,10 +37,144 @@ static void catch_int(int sig) {
   fprintf(stderr, "\nSignal %d catched, closing.\n", sig);
 }
 
+uint16_t parse_port(const char *str) {
+  long port_long = strtol(str, NULL, 10);
+  if (errno == ERANGE || port_long <= 0 || port_long > UINT16_MAX)
+    fatal("\"%s\" is not a valid and positive uint16_t", str);
+  return (uint16_t) port_long;
+}
+
+// Buffers datagrams are received into, reused for every batch.
+struct recv_pool_t {
+  recv_pool_t()
+      : buffers(RECV_BATCH), iovecs(RECV_BATCH), msgs(RECV_BATCH) {}
+
+  std::vector<datagram_with_file_t> buffers;
+  std::vector<struct iovec> iovecs;
+  std::vector<struct mmsghdr> msgs;
+};
+
+// Receives everything waiting on the socket (up to RECV_BUDGET datagrams)
+// and prints it, one batch at a time.
+void receive_all(int sock, recv_pool_t &pool, output_t &output,
+                 reassembly_t *reassembly) {
+  for (size_t received = 0; received < RECV_BUDGET; ) {
+    for (size_t i = 0; i < RECV_BATCH; ++i) {
+      pool.iovecs[i].iov_base = &pool.buffers[i];
+      pool.iovecs[i].iov_len = sizeof(datagram_with_file_t);
+      memset(&pool.msgs[i], 0, sizeof(struct mmsghdr));
+      pool.msgs[i].msg_hdr.msg_iov = &pool.iovecs[i];
+      pool.msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int recv_count = recvmmsg(sock, pool.msgs.data(), RECV_BATCH,
+                              MSG_DONTWAIT, NULL);
+    if (recv_count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    checkerr(recv_count, "recvmmsg");
+
+    for (int i = 0; i < recv_count; ++i) {
+      const datagram_with_file_t &datagram = pool.buffers[i];
+      size_t size = pool.msgs[i].msg_len;
+      if (reassembly != NULL) {
+        if (!reassembly->receive((const char *) &datagram, size))
+          fprintf(stderr, "Invalid chunk received\n");
+        continue;
+      }
+      if (size < HEADER_LENGTH) {
+        fprintf(stderr, "Invalid datagram received\n");
+        continue;
+      }
+      // The file's text ends with the datagram or at a NULL character.
+      size_t length = strnlen(datagram.file_content, size - HEADER_LENGTH);
+      output.add(bswap_64(datagram.timestamp), datagram.c,
+                 datagram.file_content, length);
+    }
+    // Buffers are reused by the next batch.
+    output.flush();
+
+    received += recv_count;
+    if (recv_count < RECV_BATCH)
+      return;
+  }
+}
+
+// Creates a socket bound to the multicast port and joins the group
+// (IPv4 or IPv6) on it.
+int join_multicast_group(const char *group, uint16_t port) {
+  struct ip_mreq mreq4;
+  struct ipv6_mreq mreq6;
+  int family;
+  if (inet_pton(AF_INET, group, &mreq4.imr_multiaddr) == 1
+      && IN_MULTICAST(ntohl(mreq4.imr_multiaddr.s_addr)))
+    family = AF_INET;
+  else if (inet_pton(AF_INET6, group, &mreq6.ipv6mr_multiaddr) == 1
+           && IN6_IS_ADDR_MULTICAST(&mreq6.ipv6mr_multiaddr))
+    family = AF_INET6;
+  else
+    fatal("\"%s\" is not a valid multicast group address", group);
+
+  int sock = socket(family, SOCK_DGRAM, 0);
+  checkerr(sock, "socket multicast");
+  // Other clients on this machine listen on the same port.
+  int reuse = 1;
+  checkerr(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)),
+           "setsockopt");
+
+  if (family == AF_INET) {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    checkerr(bind(sock, (struct sockaddr *) &address, sizeof(address)),
+             "bind multicast");
+    mreq4.imr_interface.s_addr = htonl(INADDR_ANY);
+    checkerr(setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                        &mreq4, sizeof(mreq4)), "setsockopt");
+  } else {
+    struct sockaddr_in6 address;
+    memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(port);
+    checkerr(bind(sock, (struct sockaddr *) &address, sizeof(address)),
+             "bind multicast");
+    mreq6.ipv6mr_interface = 0;
+    checkerr(setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP,
+                        &mreq6, sizeof(mreq6)), "setsockopt");
+  }
+  return sock;
+}
+
 int main(int argc, char *argv[]) {
 
+  const char *multicast_group = NULL;
+  uint16_t multicast_port = MULTICAST_PORT_DEFAULT;
+  bool streaming = false;
+  int option;
+  while ((option = getopt(argc, argv, "m:M:s")) != -1) {
+    switch (option) {
+      case 'm':
+        multicast_group = optarg;
+        break;
+      case 'M':
+        multicast_port = parse_port(optarg);
+        break;
+      case 's':
+        // The server sends files in chunks (its -c option).
+        streaming = true;
+        break;
+      default:
+        fatal(USAGE, argv[0]);
+    }
+  }
+  // Positional arguments are shifted to argv[1], argv[0] is lost.
+  const char *program = argv[0];
+  argc -= optind - 1;
+  argv += optind - 1;
+
   if (argc < 4 || argc > 5)
-    fatal("Usage: %s timestamp c host [port]", argv[0]);
+    fatal(USAGE, program);
 
   uint64_t timestamp = strtoull(argv[1], NULL, 10);
 
@@ -37,12 +183,8 @@ int main(int argc, char *argv[]) {
   char c = argv[2][0];
 
   uint16_t port = PORT_DEFAULT;
-  if (argc == 5) {
-    long port_long = strtol(argv[4], NULL, 10);
-    if (errno == ERANGE || port_long <= 0 || port_long > UINT16_MAX)
-      fatal("\"%s\" is not a valid and positive uint16_t", argv[4]);
-    port = (uint16_t) port_long;
-  }
+  if (argc == 5)
+    port = parse_port(argv[4]);
   char port_string[10];
   sprintf(port_string, "%d", port);
 
@@ -77,43 +219,54 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  // With multicast, datagrams from the server come from the group.
+  int multicast_sock = -1;
+  if (multicast_group != NULL)
+    multicast_sock = join_multicast_group(multicast_group, multicast_port);
+
   socklen_t addrlen = sizeof(my_address);
-  small_datagram_t send_buffer;
-  send_buffer.timestamp = bswap_64(timestamp);
-  send_buffer.c = c;
-  checkerr((int) sendto(sock, &send_buffer, sizeof(send_buffer), 0,
+  // Header as sent on the wire, followed by MULTICAST_FLAG if needed.
+  char send_buffer[HEADER_LENGTH + 1];
+  uint64_t timestamp_be = bswap_64(timestamp);
+  memcpy(send_buffer, &timestamp_be, sizeof(timestamp_be));
+  send_buffer[sizeof(uint64_t)] = c;
+  send_buffer[HEADER_LENGTH] = MULTICAST_FLAG;
+  size_t send_size = HEADER_LENGTH + (multicast_sock >= 0 ? 1 : 0);
+  checkerr((int) sendto(sock, send_buffer, send_size, 0,
                         (struct sockaddr*) &my_address, addrlen), "sendto");
 
-  datagram_with_file_t recv_buffer;
-  struct sockaddr_in server_address;
-  socklen_t server_addrlen = sizeof(server_address);
+  recv_pool_t pool;
+  output_t output(STDOUT_FILENO, RECV_BATCH);
+  reassembly_t reassembly(stdout);
 
-  struct pollfd recv_pollfd;
-  recv_pollfd.fd = sock;
-  recv_pollfd.events = POLLIN;
-  recv_pollfd.revents = 0;
+  struct pollfd recv_pollfds[2];
+  recv_pollfds[0].fd = sock;
+  recv_pollfds[1].fd = multicast_sock;
+  nfds_t nfds = multicast_sock >= 0 ? 2 : 1;
+  for (nfds_t i = 0; i < 2; ++i) {
+    recv_pollfds[i].events = POLLIN;
+    recv_pollfds[i].revents = 0;
+  }
 
   while (true) {
-    recv_pollfd.revents = 0;
+    recv_pollfds[0].revents = recv_pollfds[1].revents = 0;
 
     if (finish) {
       checkerr(close(sock), "close");
+      if (multicast_sock >= 0)
+        checkerr(close(multicast_sock), "close");
       break;
     }
 
-    checkerr(poll(&recv_pollfd, 1, 5000), "poll");
-
-    if (recv_pollfd.revents & POLLIN) {
-      ssize_t recv_size = recvfrom(
-          sock, &recv_buffer, sizeof(recv_buffer), 0,
-          (struct sockaddr *) &server_address, &server_addrlen);
-      checkerr((int) recv_size, "recvfrom");
+    int poll_ret = poll(recv_pollfds, nfds, 5000);
+    if (poll_ret < 0 && errno == EINTR)
+      continue;
+    checkerr(poll_ret, "poll");
 
-      printf("%" PRIu64 " %c %s\n",
-             bswap_64(recv_buffer.timestamp),
-             recv_buffer.c,
-             recv_buffer.file_content);
-    }
+    for (nfds_t i = 0; i < nfds; ++i)
+      if (recv_pollfds[i].revents & POLLIN)
+        receive_all(recv_pollfds[i].fd, pool, output,
+                    streaming ? &reassembly : NULL);
   }
 
   close(sock);
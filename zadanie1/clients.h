@@ -0,0 +1,189 @@
+#ifndef ZADANIE1_CLIENTS_H
+#define ZADANIE1_CLIENTS_H
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+#include <netinet/in.h>
+
+#include "budget.h"
+
+// Clients which didn't send anything for this many seconds are forgotten.
+#define CLIENT_TIMEOUT 120
+// Number of one-second slots in the timing wheel, must be bigger than
+// CLIENT_TIMEOUT so that every deadline fits in one turn of the wheel.
+#define WHEEL_SIZE 128
+#define INITIAL_TABLE_SIZE 64
+#define EMPTY_SLOT UINT32_MAX
+
+struct client_t {
+  in_addr_t addr;
+  in_port_t port;
+  time_t last_active;
+  uint64_t next_seq; // sequence number of the next datagram to send
+  uint32_t next_chunk; // in streaming mode, next chunk of that datagram
+  token_bucket_t pace; // in streaming mode, paces chunks sent to the client
+  bool multicast;    // listens on the multicast group, no unicast needed
+};
+
+// Registry of active clients.
+// Clients are kept in a dense array, so that fan-out only goes through
+// clients that are still active. They are found by address in an
+// open-addressing hash table (linear probing) of indexes into that array.
+// Expiry is done with a timing wheel: every client has exactly one entry
+// in the slot of the second in which it may expire. When the slot comes,
+// the client is either removed or, if it was active in the meantime,
+// moved to the slot of its new deadline. Nothing ever scans all clients.
+class client_registry_t {
+ public:
+  client_registry_t()
+      : table(INITIAL_TABLE_SIZE, EMPTY_SLOT), wheel(WHEEL_SIZE), wheel_time(0),
+        multicast_clients(0) {}
+
+  // Returns the client with the given address, registering it first
+  // if it isn't known; created is set to true in that case.
+  client_t &touch(in_addr_t addr, in_port_t port, time_t now, bool &created) {
+    size_t slot = find_slot(addr, port);
+    created = table[slot] == EMPTY_SLOT;
+    if (created) {
+      client_t client;
+      client.addr = addr;
+      client.port = port;
+      client.next_seq = 0;
+      client.next_chunk = 0;
+      client.pace.tokens = 0;
+      client.pace.last_us = 0;
+      client.multicast = false;
+      table[slot] = (uint32_t) clients.size();
+      clients.push_back(client);
+      schedule(addr, port, now + CLIENT_TIMEOUT + 1);
+      if (2 * clients.size() > table.size())
+        rehash(2 * table.size());
+    }
+    client_t &client = clients[table[find_slot(addr, port)]];
+    client.last_active = now;
+    return client;
+  }
+
+  // Returns the client with the given address, or NULL if it isn't known.
+  client_t *find(in_addr_t addr, in_port_t port) {
+    size_t slot = find_slot(addr, port);
+    return table[slot] == EMPTY_SLOT ? NULL : &clients[table[slot]];
+  }
+
+  // Removes clients which weren't active in the last CLIENT_TIMEOUT seconds.
+  void expire(time_t now) {
+    if (wheel_time == 0)
+      wheel_time = now;
+    else if (now - wheel_time > WHEEL_SIZE)
+      // Clock jumped, one turn of the wheel checks every client.
+      wheel_time = now - WHEEL_SIZE;
+    while (wheel_time < now) {
+      ++wheel_time;
+      std::vector<uint64_t> due;
+      due.swap(wheel[wheel_time % WHEEL_SIZE]);
+      for (uint64_t key : due) {
+        in_addr_t addr = (in_addr_t) (key >> 16);
+        in_port_t port = (in_port_t) (key & 0xffff);
+        size_t slot = find_slot(addr, port);
+        if (table[slot] == EMPTY_SLOT)
+          continue;
+        time_t deadline =
+            clients[table[slot]].last_active + CLIENT_TIMEOUT + 1;
+        if (deadline <= now)
+          remove(slot);
+        else
+          schedule(addr, port, deadline);
+      }
+    }
+  }
+
+  size_t size() const {
+    return clients.size();
+  }
+
+  // Marks whether the client listens on the multicast group. Has to be used
+  // instead of setting client.multicast, so that such clients are counted.
+  void set_multicast(client_t &client, bool multicast) {
+    if (client.multicast != multicast)
+      multicast ? ++multicast_clients : --multicast_clients;
+    client.multicast = multicast;
+  }
+
+  // Number of clients which need unicast copies.
+  size_t unicast_size() const {
+    return clients.size() - multicast_clients;
+  }
+
+  client_t &operator[](size_t i) {
+    return clients[i];
+  }
+
+ private:
+  static uint64_t make_key(in_addr_t addr, in_port_t port) {
+    return (((uint64_t) addr) << 16) | port;
+  }
+
+  size_t hash(in_addr_t addr, in_port_t port) const {
+    uint64_t h = make_key(addr, port) * 0x9e3779b97f4a7c15ULL;
+    return (size_t) (h >> 32) & (table.size() - 1);
+  }
+
+  // Returns the slot holding the given client, or the empty slot
+  // where it would be inserted.
+  size_t find_slot(in_addr_t addr, in_port_t port) const {
+    size_t slot = hash(addr, port);
+    while (table[slot] != EMPTY_SLOT
+           && (clients[table[slot]].addr != addr
+               || clients[table[slot]].port != port))
+      slot = (slot + 1) & (table.size() - 1);
+    return slot;
+  }
+
+  void schedule(in_addr_t addr, in_port_t port, time_t deadline) {
+    wheel[deadline % WHEEL_SIZE].push_back(make_key(addr, port));
+  }
+
+  // Removes the client from the table slot and the dense array.
+  void remove(size_t slot) {
+    uint32_t index = table[slot];
+
+    // Backward shift deletion, so that no probe sequence gets broken.
+    size_t mask = table.size() - 1;
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; table[next] != EMPTY_SLOT;
+         next = (next + 1) & mask) {
+      const client_t &client = clients[table[next]];
+      size_t home = hash(client.addr, client.port);
+      // Move the entry if its home slot isn't between the hole and it.
+      if (((next - home) & mask) >= ((next - hole) & mask)) {
+        table[hole] = table[next];
+        hole = next;
+      }
+    }
+    table[hole] = EMPTY_SLOT;
+
+    if (clients[index].multicast)
+      --multicast_clients;
+    // Move the last client into the freed place in the array.
+    if (index + 1 != clients.size()) {
+      clients[index] = clients.back();
+      table[find_slot(clients[index].addr, clients[index].port)] = index;
+    }
+    clients.pop_back();
+  }
+
+  void rehash(size_t new_size) {
+    table.assign(new_size, EMPTY_SLOT);
+    for (uint32_t i = 0; i < clients.size(); ++i)
+      table[find_slot(clients[i].addr, clients[i].port)] = i;
+  }
+
+  std::vector<client_t> clients;
+  std::vector<uint32_t> table;
+  std::vector<std::vector<uint64_t>> wheel;
+  time_t wheel_time; // last second processed by expire
+  size_t multicast_clients;
+};
+
+#endif //ZADANIE1_CLIENTS_H
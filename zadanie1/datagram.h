@@ -4,12 +4,47 @@
 #include <cstdint>
 
 #define MAX_FILE_LENGTH 65000
+// Length of timestamp and character on the wire, without padding.
+#define HEADER_LENGTH (sizeof(uint64_t) + sizeof(char))
+// Optional byte after the header of a client's datagram, meaning that
+// the client listens on the server's multicast group.
+#define MULTICAST_FLAG 'M'
 
 struct small_datagram_t {
   uint64_t timestamp;
   char c;
 };
 
+// In streaming mode, every datagram from the server has this header
+// (in network byte order) after the timestamp and character,
+// followed by one chunk of the file.
+struct __attribute__((__packed__)) chunk_header_t {
+  uint32_t message_id;  // the same for all chunks of one message
+  uint32_t chunk;       // number of this chunk, starting from 0
+  uint32_t chunk_count;
+};
+
+#define CHUNK_HEADER_LENGTH (HEADER_LENGTH + sizeof(chunk_header_t))
+#define MAX_CHUNK_SIZE (MAX_FILE_LENGTH - sizeof(chunk_header_t))
+
+// Datagram forwarded from one server to its peers (see peers.h),
+// in network byte order. The file isn't sent, every server appends its own.
+#define PEER_MAGIC 0x53494b50 // "SIKP"
+struct __attribute__((__packed__)) peer_datagram_t {
+  uint32_t magic;
+  uint32_t origin;   // id of the server that received it from a client
+  uint16_t stream;   // sending shard of that server
+  uint64_t seq;      // number in the stream, separate for every peer
+  uint64_t timestamp;
+  char c;
+};
+
+// Buffer for any datagram the server accepts, from a client or a peer.
+union received_datagram_t {
+  small_datagram_t client;
+  peer_datagram_t peer;
+};
+
 struct datagram_with_file_t {
   uint64_t timestamp;
   char c;
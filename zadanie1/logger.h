@@ -0,0 +1,254 @@
+#ifndef ZADANIE1_LOGGER_H
+#define ZADANIE1_LOGGER_H
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// Number of records in the ring, must be a power of two.
+#define LOG_RING_SIZE 65536
+// How often the flusher writes out what was logged, in microseconds.
+#define LOG_FLUSH_INTERVAL 10000
+// Records of one kind logged in one second, more are only counted.
+#define LOG_SAMPLE_LIMIT 1000
+
+// Kinds of records, every one has its own message.
+enum log_kind_t {
+  LOG_RECEIVED,          // addr, port
+  LOG_SENT,              // addr, port
+  LOG_SENT_MULTICAST,
+  LOG_PEER_RECEIVED,     // addr, port
+  LOG_PEER_INVALID,      // addr, port
+  LOG_PEER_LATE,         // addr, port, total
+  LOG_PEER_LOST,         // addr, port, count, total
+  LOG_KINDS
+};
+
+struct log_record_t {
+  uint8_t kind;
+  in_port_t port; // network byte order
+  in_addr_t addr; // network byte order
+  uint64_t count;
+  uint64_t total;
+};
+
+// Log written in the background. Logging a record only copies a few numbers
+// into a lock-free ring (any number of threads may log at once); a flusher
+// thread formats records and writes them to a file descriptor in big chunks.
+// When the ring is full, records are dropped (and counted) rather than
+// blocking the caller. Every kind of record is sampled: at most
+// LOG_SAMPLE_LIMIT of them per second are kept, the rest are summarised.
+class logger_t {
+ public:
+  logger_t(int fd) : fd(fd), head(0), tail(0), last_summary(0), dropped(0),
+                     running(false) {
+    for (size_t i = 0; i < LOG_RING_SIZE; ++i)
+      ring[i].seq.store(i, std::memory_order_relaxed);
+    for (size_t i = 0; i < LOG_KINDS; ++i) {
+      samples[i].second.store(0, std::memory_order_relaxed);
+      samples[i].count.store(0, std::memory_order_relaxed);
+      samples[i].suppressed.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void start() {
+    running = true;
+    flusher = std::thread(&logger_t::run, this);
+  }
+
+  // The logger is a global, so it's destroyed by exit() (e.g. from syserr)
+  // while the flusher still runs; a joinable thread can't be destroyed.
+  ~logger_t() {
+    if (!flusher.joinable())
+      return;
+    if (flusher.get_id() == std::this_thread::get_id())
+      flusher.detach();
+    else
+      stop();
+  }
+
+  // Writes out everything logged so far and stops the flusher.
+  void stop() {
+    if (!running)
+      return;
+    running = false;
+    flusher.join();
+    flush(true);
+  }
+
+  void log(log_kind_t kind, in_addr_t addr = 0, in_port_t port = 0,
+           uint64_t count = 0, uint64_t total = 0) {
+    if (!sample(kind))
+      return;
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    slot_t *slot;
+    while (true) {
+      slot = &ring[pos & (LOG_RING_SIZE - 1)];
+      uint64_t seq = slot->seq.load(std::memory_order_acquire);
+      if (seq == pos) {
+        if (head.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed))
+          break;
+      } else if (seq < pos) {
+        // The flusher didn't free this slot yet, the ring is full.
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+    slot->record.kind = (uint8_t) kind;
+    slot->record.addr = addr;
+    slot->record.port = port;
+    slot->record.count = count;
+    slot->record.total = total;
+    slot->seq.store(pos + 1, std::memory_order_release);
+  }
+
+ private:
+  struct slot_t {
+    // pos + 1 once the record at position pos is written,
+    // pos + LOG_RING_SIZE once it's read and the slot is free again.
+    std::atomic<uint64_t> seq;
+    log_record_t record;
+  };
+
+  struct sample_t {
+    std::atomic<uint64_t> second;
+    std::atomic<uint32_t> count;
+    std::atomic<uint64_t> suppressed;
+  };
+
+  // Returns false if too many records of this kind were logged this second.
+  bool sample(log_kind_t kind) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    uint64_t second = (uint64_t) ts.tv_sec;
+    sample_t &s = samples[kind];
+    if (s.second.load(std::memory_order_relaxed) != second) {
+      s.second.store(second, std::memory_order_relaxed);
+      s.count.store(0, std::memory_order_relaxed);
+    }
+    if (s.count.fetch_add(1, std::memory_order_relaxed) < LOG_SAMPLE_LIMIT)
+      return true;
+    s.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  void run() {
+    while (running) {
+      usleep(LOG_FLUSH_INTERVAL);
+      flush(false);
+    }
+  }
+
+  // Formats all records written so far and writes them out at once.
+  // Records which weren't logged are summarised once per second.
+  void flush(bool last) {
+    buffer.clear();
+    while (true) {
+      slot_t &slot = ring[tail & (LOG_RING_SIZE - 1)];
+      if (slot.seq.load(std::memory_order_acquire) != tail + 1)
+        break;
+      format(slot.record);
+      slot.seq.store(tail + LOG_RING_SIZE, std::memory_order_release);
+      ++tail;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    if (last || ts.tv_sec != last_summary) {
+      last_summary = ts.tv_sec;
+      for (size_t i = 0; i < LOG_KINDS; ++i) {
+        uint64_t suppressed =
+            samples[i].suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed > 0)
+          append("... %" PRIu64 " more \"%s\" messages not logged\n",
+                 suppressed, NAMES[i]);
+      }
+      uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+      if (lost > 0)
+        append("... log full, %" PRIu64 " messages dropped\n", lost);
+    }
+
+    for (size_t done = 0; done < buffer.size(); ) {
+      ssize_t written = write(fd, buffer.data() + done, buffer.size() - done);
+      if (written <= 0)
+        break;
+      done += written;
+    }
+  }
+
+  void format(const log_record_t &record) {
+    char str[INET_ADDRSTRLEN];
+    struct in_addr addr;
+    addr.s_addr = record.addr;
+    inet_ntop(AF_INET, &addr, str, INET_ADDRSTRLEN);
+    int port = ntohs(record.port);
+    switch (record.kind) {
+      case LOG_RECEIVED:
+        append("Received from %s:%d\n", str, port);
+        break;
+      case LOG_SENT:
+        append("Sending to %s:%d\n", str, port);
+        break;
+      case LOG_SENT_MULTICAST:
+        append("Sending to multicast group\n");
+        break;
+      case LOG_PEER_RECEIVED:
+        append("Received from peer %s:%d\n", str, port);
+        break;
+      case LOG_PEER_INVALID:
+        append("Invalid datagram from peer %s:%d\n", str, port);
+        break;
+      case LOG_PEER_LATE:
+        append("Datagram from peer %s:%d out of order, dropped "
+               "(%" PRIu64 " so far)\n", str, port, record.total);
+        break;
+      case LOG_PEER_LOST:
+        append("Lost %" PRIu64 " datagrams from peer %s:%d "
+               "(%" PRIu64 " so far)\n", record.count, str, port,
+               record.total);
+        break;
+      default:
+        break;
+    }
+  }
+
+  void append(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (length > 0)
+      buffer.append(line, (size_t) length < sizeof(line)
+                          ? (size_t) length : sizeof(line) - 1);
+  }
+
+  static constexpr const char *NAMES[LOG_KINDS] = {
+      "Received from", "Sending to", "Sending to multicast group",
+      "Received from peer", "Invalid datagram from peer",
+      "Datagram from peer out of order", "Lost datagrams from peer"};
+
+  int fd;
+  slot_t ring[LOG_RING_SIZE];
+  std::atomic<uint64_t> head;
+  uint64_t tail; // only used by the flusher
+  time_t last_summary;
+  std::atomic<uint64_t> dropped;
+  sample_t samples[LOG_KINDS];
+  std::atomic<bool> running;
+  std::thread flusher;
+  std::string buffer;
+};
+
+constexpr const char *logger_t::NAMES[LOG_KINDS];
+
+#endif //ZADANIE1_LOGGER_H
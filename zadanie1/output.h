@@ -0,0 +1,87 @@
+#ifndef ZADANIE1_OUTPUT_H
+#define ZADANIE1_OUTPUT_H
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "err.h"
+
+// Size the pipe on standard output is grown to, if it is a pipe.
+#define OUTPUT_PIPE_SIZE (1 << 20)
+// Longest uint64_t, a space, a character, a space and the terminator.
+#define OUTPUT_PREFIX_LENGTH 24
+
+// Collects lines made of pieces of received datagrams (which stay
+// in their buffers until flush) and writes them with as few writev calls
+// as possible. Only short prefixes are formatted into its own memory.
+class output_t {
+ public:
+  output_t(int fd, size_t max_lines)
+      : fd(fd), prefixes(max_lines * OUTPUT_PREFIX_LENGTH), lines(0) {
+    iovecs.reserve(3 * max_lines);
+    // A bigger pipe lets a slower reader fall behind without blocking us
+    // on every batch. It's fine if it can't be changed.
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+      fcntl(fd, F_SETPIPE_SZ, OUTPUT_PIPE_SIZE);
+  }
+
+  // Adds the line "timestamp c content\n". The content has to stay
+  // unchanged until flush.
+  void add(uint64_t timestamp, char c, const char *content, size_t length) {
+    char *prefix = &prefixes[lines * OUTPUT_PREFIX_LENGTH];
+    int prefix_length = snprintf(prefix, OUTPUT_PREFIX_LENGTH,
+                                 "%" PRIu64 " %c ", timestamp, c);
+    add_piece(prefix, (size_t) prefix_length);
+    add_piece(content, length);
+    add_piece("\n", 1);
+    ++lines;
+  }
+
+  // Writes all lines added so far.
+  void flush() {
+    size_t done = 0;
+    while (done < iovecs.size()) {
+      size_t count = iovecs.size() - done;
+      if (count > IOV_MAX)
+        count = IOV_MAX;
+      ssize_t written = writev(fd, &iovecs[done], (int) count);
+      if (written < 0 && errno == EINTR)
+        continue;
+      checkerr((int) written, "writev");
+      // Skip what was written, a piece may have been written partially.
+      while (done < iovecs.size() && (size_t) written >= iovecs[done].iov_len)
+        written -= iovecs[done++].iov_len;
+      if (written > 0) {
+        iovecs[done].iov_base = (char *) iovecs[done].iov_base + written;
+        iovecs[done].iov_len -= written;
+      }
+    }
+    iovecs.clear();
+    lines = 0;
+  }
+
+ private:
+  void add_piece(const char *data, size_t length) {
+    if (length == 0)
+      return;
+    struct iovec iov;
+    iov.iov_base = (void *) data;
+    iov.iov_len = length;
+    iovecs.push_back(iov);
+  }
+
+  int fd;
+  std::vector<char> prefixes;
+  std::vector<struct iovec> iovecs;
+  size_t lines;
+};
+
+#endif //ZADANIE1_OUTPUT_H
@@ -0,0 +1,123 @@
+#ifndef ZADANIE1_PAYLOAD_H
+#define ZADANIE1_PAYLOAD_H
+
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "datagram.h"
+
+// File content appended to every datagram sent by the server.
+// The file is read once into memory of its own and every outgoing datagram
+// points into it, so the content is never copied again. Later changes to
+// the file (even truncating it) don't affect a payload already loaded.
+struct payload_t {
+  const char *content;
+  size_t length;        // bytes sent, at most max_length given when loading
+  size_t allocated_length; // of the memory holding it, 0 if none
+};
+
+// Reads at most max_length first bytes of the given file (which doesn't have
+// to be a regular one). Returns false (with errno set) if the file can't be
+// opened or read.
+bool try_load_payload(const char *filename, size_t max_length,
+                     payload_t &payload) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0) {
+    close(fd);
+    return false;
+  }
+
+  // The size of a regular file is known, others are read into memory
+  // which grows as needed, up to max_length.
+  bool regular = S_ISREG(file_stat.st_mode);
+  size_t capacity = max_length;
+  if (regular && (size_t) file_stat.st_size < capacity)
+    capacity = (size_t) file_stat.st_size;
+  else if (!regular && capacity > MAX_FILE_LENGTH)
+    capacity = MAX_FILE_LENGTH;
+
+  payload.content = NULL;
+  payload.length = payload.allocated_length = 0;
+  if (capacity == 0) {
+    checkerr(close(fd), "close");
+    return true;
+  }
+  void *buffer = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  size_t length = 0;
+  while (true) {
+    if (length == capacity) {
+      if (regular || capacity == max_length)
+        break;
+      size_t new_capacity =
+          capacity > max_length / 2 ? max_length : 2 * capacity;
+      void *grown = mremap(buffer, capacity, new_capacity, MREMAP_MAYMOVE);
+      if (grown == MAP_FAILED)
+        break;  // send as much as fits
+      buffer = grown;
+      capacity = new_capacity;
+    }
+    ssize_t read_ret = read(fd, (char *) buffer + length, capacity - length);
+    if (read_ret < 0 && errno == EINTR)
+      continue;
+    if (read_ret < 0) {
+      int read_errno = errno;
+      munmap(buffer, capacity);
+      close(fd);
+      errno = read_errno;
+      return false;
+    }
+    if (read_ret == 0)
+      break;  // end of the file (a regular one could've got shorter)
+    length += (size_t) read_ret;
+  }
+  checkerr(mprotect(buffer, capacity, PROT_READ), "mprotect");
+  payload.content = (const char *) buffer;
+  payload.length = length;
+  payload.allocated_length = capacity;
+  checkerr(close(fd), "close");
+  return true;
+}
+
+// Like try_load_payload, but fails if the file can't be read.
+payload_t load_payload(const char *filename, size_t max_length) {
+  payload_t payload;
+  if (!try_load_payload(filename, max_length, payload))
+    fatal("error opening file \"%s\"", filename);
+  return payload;
+}
+
+void free_payload(payload_t &payload) {
+  if (payload.allocated_length > 0)
+    checkerr(munmap((void *) payload.content, payload.allocated_length),
+             "munmap");
+  payload.content = NULL;
+  payload.length = payload.allocated_length = 0;
+}
+
+// Shared reference to a payload, which is freed when the last
+// reference is dropped.
+typedef std::shared_ptr<const payload_t> payload_ref_t;
+
+payload_ref_t make_payload_ref(const payload_t &payload) {
+  return payload_ref_t(new payload_t(payload), [](const payload_t *loaded) {
+    payload_t freed = *loaded;
+    free_payload(freed);
+    delete loaded;
+  });
+}
+
+#endif //ZADANIE1_PAYLOAD_H
@@ -0,0 +1,44 @@
+#ifndef ZADANIE1_PEERS_H
+#define ZADANIE1_PEERS_H
+
+#include <cstdint>
+#include <vector>
+#include <netinet/in.h>
+
+#include "datagram.h"
+
+// Streams a server may get from one peer (one per shard of that peer).
+#define PEER_STREAMS 256
+
+// Another server of the mesh. Servers configured as peers of each other
+// share one channel: a datagram a server gets from one of its clients is
+// forwarded once to every peer, which sends it to its own clients.
+// Datagrams from peers are never forwarded again, so in a full mesh
+// nothing loops; a datagram coming back to the server it started from
+// (with a misconfigured mesh) is dropped by its origin id.
+// Every shard numbers datagrams it forwards to a peer, the peer drops
+// the ones older than the last one it got, so it keeps their order.
+struct peer_t {
+  peer_t(const struct sockaddr_in &addr)
+      : addr(addr), next_seq(0), forwarded(0), origin(0),
+        expected(PEER_STREAMS, 0), lost(0), late(0) {}
+
+  struct sockaddr_in addr;
+  uint64_t next_seq;  // next queued datagram to forward to it
+  uint64_t forwarded; // number of the next datagram forwarded to it
+  uint32_t origin;    // id of the peer, 0 until it sends something
+  std::vector<uint64_t> expected; // next expected number, for every stream
+  uint64_t lost;      // skipped numbers, datagrams lost on the way
+  uint64_t late;      // datagrams dropped because they came out of order
+};
+
+// Returns the peer with the given address, or NULL if it isn't a peer.
+peer_t *find_peer(std::vector<peer_t> &peers, const struct sockaddr_in &from) {
+  for (peer_t &peer : peers)
+    if (peer.addr.sin_addr.s_addr == from.sin_addr.s_addr
+        && peer.addr.sin_port == from.sin_port)
+      return &peer;
+  return NULL;
+}
+
+#endif //ZADANIE1_PEERS_H
@@ -0,0 +1,54 @@
+#ifndef ZADANIE1_QUEUE_H
+#define ZADANIE1_QUEUE_H
+
+#include <cstdint>
+#include <netinet/in.h>
+
+#include "payload.h"
+
+#define QUEUE_SIZE 4096
+
+// Header of a received datagram, waiting to be sent to other clients.
+// The file content isn't copied, only the version of the file that was
+// current when the datagram came is referenced, so it stays loaded
+// (even if the file is reloaded) until the datagram is overwritten.
+struct queued_datagram_t {
+  uint64_t timestamp; // already in network byte order
+  char c;
+  in_addr_t sender_addr;
+  in_port_t sender_port;
+  bool from_peer; // forwarded by another server, not forwarded again
+  payload_ref_t payload;
+};
+
+// Ring buffer of the last QUEUE_SIZE received datagrams.
+// Every pushed datagram gets a sequence number, which is never reused,
+// so each client only has to remember the number of the next datagram
+// it should get. When the buffer is full, the oldest datagram is overwritten.
+class datagram_queue_t {
+ public:
+  uint64_t push(const queued_datagram_t &datagram) {
+    ring[next_seq % QUEUE_SIZE] = datagram;
+    return next_seq++;
+  }
+
+  // Sequence number of the oldest datagram still in the buffer.
+  uint64_t oldest() const {
+    return next_seq > QUEUE_SIZE ? next_seq - QUEUE_SIZE : 0;
+  }
+
+  // Sequence number that the next pushed datagram will get.
+  uint64_t end() const {
+    return next_seq;
+  }
+
+  const queued_datagram_t &at(uint64_t seq) const {
+    return ring[seq % QUEUE_SIZE];
+  }
+
+ private:
+  queued_datagram_t ring[QUEUE_SIZE];
+  uint64_t next_seq = 0;
+};
+
+#endif //ZADANIE1_QUEUE_H
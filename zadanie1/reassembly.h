@@ -0,0 +1,142 @@
+#ifndef ZADANIE1_REASSEMBLY_H
+#define ZADANIE1_REASSEMBLY_H
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <arpa/inet.h>
+#include <byteswap.h>
+
+#include "datagram.h"
+
+// Number of chunks that may arrive ahead of the next one to print,
+// must be a power of two.
+#define REASSEMBLY_WINDOW 64
+
+// Puts chunks of streamed messages back in order and prints every message
+// as one line, writing chunks as soon as all chunks before them were written,
+// so memory use doesn't depend on the size of the file.
+// Chunks that arrive too early are kept in a window of REASSEMBLY_WINDOW
+// chunks; if it overflows, the missing chunks are given up on.
+// One message is reassembled at a time, a chunk of a new message ends
+// the current one even if it isn't complete.
+class reassembly_t {
+ public:
+  reassembly_t(FILE *out)
+      : out(out), active(false), finished_id(0), has_finished(false),
+        window(REASSEMBLY_WINDOW) {}
+
+  // Handles one received datagram of length size. Returns false if it
+  // is too short to be a chunk.
+  bool receive(const char *datagram, size_t size) {
+    if (size < CHUNK_HEADER_LENGTH)
+      return false;
+    uint64_t timestamp;
+    memcpy(&timestamp, datagram, sizeof(timestamp));
+    char c = datagram[sizeof(uint64_t)];
+    chunk_header_t header;
+    memcpy(&header, datagram + HEADER_LENGTH, sizeof(header));
+    uint32_t message_id = ntohl(header.message_id);
+    uint32_t chunk = ntohl(header.chunk);
+    uint32_t chunk_count = ntohl(header.chunk_count);
+    if (chunk >= chunk_count)
+      return false;
+
+    if (has_finished && message_id == finished_id)
+      // Late copy of a chunk of a message that was already printed.
+      return true;
+    if (!active || message_id != this->message_id) {
+      if (active)
+        give_up();
+      start(message_id, bswap_64(timestamp), c, chunk_count);
+    }
+    if (chunk < next_chunk)
+      return true;
+
+    // Make room in the window, skipping chunks that didn't come in time.
+    while (chunk >= next_chunk + REASSEMBLY_WINDOW) {
+      slot_t &slot = window[next_chunk % REASSEMBLY_WINDOW];
+      if (slot.filled)
+        write(slot);
+      else
+        fprintf(stderr, "Chunk %" PRIu32 " of message %" PRIu32 " lost\n",
+                next_chunk, message_id);
+      ++next_chunk;
+    }
+
+    slot_t &slot = window[chunk % REASSEMBLY_WINDOW];
+    slot.data.assign(datagram + CHUNK_HEADER_LENGTH, datagram + size);
+    slot.filled = true;
+    flush();
+    return true;
+  }
+
+ private:
+  struct slot_t {
+    slot_t() : filled(false) {}
+
+    std::vector<char> data;
+    bool filled;
+  };
+
+  void start(uint32_t message_id, uint64_t timestamp, char c,
+             uint32_t chunk_count) {
+    active = true;
+    this->message_id = message_id;
+    this->chunk_count = chunk_count;
+    next_chunk = 0;
+    for (slot_t &slot : window)
+      slot.filled = false;
+    fprintf(out, "%" PRIu64 " %c ", timestamp, c);
+  }
+
+  // Writes all chunks that are in order, ends the line after the last one.
+  void flush() {
+    while (next_chunk < chunk_count) {
+      slot_t &slot = window[next_chunk % REASSEMBLY_WINDOW];
+      if (!slot.filled)
+        return;
+      write(slot);
+      ++next_chunk;
+    }
+    fprintf(out, "\n");
+    fflush(out);
+    active = false;
+    has_finished = true;
+    finished_id = message_id;
+  }
+
+  void write(slot_t &slot) {
+    fwrite(slot.data.data(), 1, slot.data.size(), out);
+    slot.filled = false;
+  }
+
+  // Ends the current message without waiting for its remaining chunks.
+  void give_up() {
+    fprintf(stderr, "Message %" PRIu32 " incomplete, %" PRIu32
+                    " of %" PRIu32 " chunks written\n",
+            message_id, next_chunk, chunk_count);
+    // Only the window may hold chunks that weren't written yet.
+    for (uint32_t i = 0; i < REASSEMBLY_WINDOW && next_chunk < chunk_count;
+         ++i, ++next_chunk) {
+      slot_t &slot = window[next_chunk % REASSEMBLY_WINDOW];
+      if (slot.filled)
+        write(slot);
+    }
+    fprintf(out, "\n");
+    active = false;
+  }
+
+  FILE *out;
+  bool active;
+  uint32_t message_id;
+  uint32_t chunk_count;
+  uint32_t next_chunk; // next chunk to write
+  uint32_t finished_id;
+  bool has_finished;
+  std::vector<slot_t> window;
+};
+
+#endif //ZADANIE1_REASSEMBLY_H
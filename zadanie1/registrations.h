@@ -0,0 +1,94 @@
+#ifndef ZADANIE1_REGISTRATIONS_H
+#define ZADANIE1_REGISTRATIONS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <netinet/in.h>
+
+// Must be a power of two.
+#define REGISTRATION_LOG_SIZE 65536
+// Entry keys are the address, port and this bit if the client uses multicast.
+#define MULTICAST_BIT (1ULL << 48)
+
+struct registration_t {
+  in_addr_t addr;
+  in_port_t port;
+  time_t time;
+  bool multicast;
+};
+
+// Lock-free log of client activity shared by all shards.
+// A shard appends an entry when one of its clients registers or is active
+// in a new second, and every shard reads all entries to keep its own
+// registry complete. Any number of threads may append at the same time.
+// Every entry carries the position it was written at plus one, which readers
+// check before and after reading it: a lower value means the entry isn't
+// published yet, a different one means a writer lapped the reader.
+class registration_log_t {
+ public:
+  registration_log_t() : write_pos(0) {
+    for (size_t i = 0; i < REGISTRATION_LOG_SIZE; ++i)
+      entries[i].seq.store(0, std::memory_order_relaxed);
+  }
+
+  void publish(in_addr_t addr, in_port_t port, time_t time, bool multicast) {
+    uint64_t pos = write_pos.fetch_add(1, std::memory_order_relaxed);
+    entry_t &entry = entries[pos % REGISTRATION_LOG_SIZE];
+    entry.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.key.store((((uint64_t) addr) << 16) | port
+                    | (multicast ? MULTICAST_BIT : 0),
+                    std::memory_order_relaxed);
+    entry.time.store((int64_t) time, std::memory_order_relaxed);
+    entry.seq.store(pos + 1, std::memory_order_release);
+  }
+
+  // Reads the entry at the reader's position pos and advances it.
+  // Returns false if there is nothing new to read. If the reader fell
+  // more than REGISTRATION_LOG_SIZE entries behind, lost entries are skipped.
+  bool read(uint64_t &pos, registration_t &registration) const {
+    while (true) {
+      const entry_t &entry = entries[pos % REGISTRATION_LOG_SIZE];
+      uint64_t seq = entry.seq.load(std::memory_order_acquire);
+      if (seq == pos + 1) {
+        uint64_t key = entry.key.load(std::memory_order_relaxed);
+        int64_t time = entry.time.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.seq.load(std::memory_order_relaxed) == seq) {
+          registration.addr = (in_addr_t) (key >> 16);
+          registration.port = (in_port_t) (key & 0xffff);
+          registration.multicast = (key & MULTICAST_BIT) != 0;
+          registration.time = (time_t) time;
+          ++pos;
+          return true;
+        }
+      } else if (seq <= pos) {
+        // Not written yet (or still being written).
+        return false;
+      }
+      // Lapped by writers, jump to the oldest entry that may still be there.
+      uint64_t end = write_pos.load(std::memory_order_relaxed);
+      if (end > REGISTRATION_LOG_SIZE && pos < end - REGISTRATION_LOG_SIZE)
+        pos = end - REGISTRATION_LOG_SIZE;
+      else
+        ++pos;
+    }
+  }
+
+  uint64_t end() const {
+    return write_pos.load(std::memory_order_acquire);
+  }
+
+ private:
+  struct entry_t {
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> key;
+    std::atomic<int64_t> time;
+  };
+
+  entry_t entries[REGISTRATION_LOG_SIZE];
+  std::atomic<uint64_t> write_pos;
+};
+
+#endif //ZADANIE1_REGISTRATIONS_H
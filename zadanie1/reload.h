@@ -0,0 +1,112 @@
+#ifndef ZADANIE1_RELOAD_H
+#define ZADANIE1_RELOAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <libgen.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "payload.h"
+
+// How often (in milliseconds) the watcher checks if it should finish.
+#define WATCH_INTERVAL 500
+
+// Source of the current version of the payload file. A watcher thread
+// reads the file again whenever it is written or replaced, and swaps
+// the new version in; readers keep the version they already took for as
+// long as they need it (like in RCU), the old one is freed when the last
+// reference goes away. Every version is a private copy, so the file can be
+// written in place (truncating it first) or replaced by renaming.
+class payload_source_t {
+ public:
+  payload_source_t(const char *filename, size_t max_length)
+      : filename(filename), max_length(max_length),
+        payload(make_payload_ref(load_payload(filename, max_length))),
+        version(0) {}
+
+  // Changes every time a new version is swapped in. Cheap to check often.
+  uint64_t generation() const {
+    return version.load(std::memory_order_acquire);
+  }
+
+  payload_ref_t current() const {
+    return std::atomic_load(&payload);
+  }
+
+  // Watches the file (through its directory, to notice it being replaced)
+  // and reloads it, until finish is set.
+  void watch(const std::atomic<bool> &finish) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    checkerr(fd, "inotify_init1");
+    std::string directory_copy = filename, name_copy = filename;
+    const char *directory = dirname(&directory_copy[0]);
+    std::string name = basename(&name_copy[0]);
+    if (inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      fprintf(stderr, "Can't watch \"%s\" (%s), reloading is off\n",
+              directory, strerror(errno));
+      close(fd);
+      return;
+    }
+
+    // Room for at least one event with the longest name.
+    char buffer[sizeof(struct inotify_event) + NAME_MAX + 1]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pollfd;
+    pollfd.fd = fd;
+    pollfd.events = POLLIN;
+    while (!finish) {
+      int poll_ret = poll(&pollfd, 1, WATCH_INTERVAL);
+      if (poll_ret < 0 && errno == EINTR)
+        continue;
+      checkerr(poll_ret, "poll inotify");
+      if (poll_ret == 0)
+        continue;
+
+      bool changed = false;
+      ssize_t length;
+      while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + length; ) {
+          const struct inotify_event *event =
+              (const struct inotify_event *) ptr;
+          if (event->len > 0 && name == event->name)
+            changed = true;
+          ptr += sizeof(struct inotify_event) + event->len;
+        }
+      }
+      if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        syserr("read inotify");
+      if (changed)
+        reload();
+    }
+    close(fd);
+  }
+
+ private:
+  void reload() {
+    payload_t loaded;
+    if (!try_load_payload(filename.c_str(), max_length, loaded)) {
+      fprintf(stderr, "Can't reload \"%s\" (%s), keeping the old version\n",
+              filename.c_str(), strerror(errno));
+      return;
+    }
+    std::atomic_store(&payload, make_payload_ref(loaded));
+    version.fetch_add(1, std::memory_order_release);
+    fprintf(stderr, "Reloaded \"%s\" (%zu bytes)\n", filename.c_str(),
+            loaded.length);
+  }
+
+  std::string filename;
+  size_t max_length;
+  payload_ref_t payload;
+  std::atomic<uint64_t> version;
+};
+
+#endif //ZADANIE1_RELOAD_H
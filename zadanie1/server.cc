@@ -10,125 +10,1090 @@
 #include <byteswap.h>
 #include <ctime>
 #include <cinttypes>
-#include <utility>
-#include <list>
-#include <map>
+#include <fcntl.h>
+#include <netdb.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <random>
 
 #include "err.h"
 #include "datagram.h"
+#include "queue.h"
+#include "clients.h"
+#include "payload.h"
+#include "reload.h"
+#include "registrations.h"
+#include "uring.h"
+#include "budget.h"
+#include "peers.h"
+#include "logger.h"
 
 using namespace std;
 
-bool finish = false;
+// Maximum number of datagrams received or sent in one loop iteration,
+// so that neither direction can starve the other.
+#define RECV_BUDGET 1024
+#define SEND_BUDGET 4096
+// Number of datagrams passed to one recvmmsg/sendmmsg call.
+#define DEFAULT_BATCH_SIZE 32
+#define MAX_BATCH_SIZE 1024
+#define MAX_WORKERS 256
+#define MULTICAST_PORT_DEFAULT 20161
+// Streaming: bytes per second sent to every client (and to the multicast
+// group), and how many bytes may be sent at once after a pause.
+#define DEFAULT_STREAM_RATE 4000000
+#define STREAM_BURST 65536
+#define USAGE "Usage: %s [-b batch_size] [-u] [-w workers] " \
+              "[-m multicast_group] [-M multicast_port] " \
+              "[-e egress_bytes_per_sec] [-E source_egress_bytes_per_sec] " \
+              "[-c chunk_size] [-r stream_bytes_per_sec] " \
+              "[-p peer_host:port]... port filename"
+// io_uring: submission queue size (enough for a full batch of sends),
+// number and size of buffers for received datagrams.
+#define URING_ENTRIES 2048
+#define URING_BUFFERS 1024
+#define URING_BUFFER_SIZE 128
+// Everything prepared in one turn of the loop (a batch of sends, the receive
+// and the timeout) is submitted at once, so get_sqe() never runs out.
+static_assert(URING_ENTRIES >= MAX_BATCH_SIZE + 2,
+              "io_uring submission queue can't hold a full batch");
+// user_data of io_uring requests; sends use URING_SEND + index in the batch.
+#define URING_RECV 0
+#define URING_TIMEOUT 1
+#define URING_SEND 2
+
+// Buffers for recvmmsg and sendmmsg, allocated once at startup.
+// Every outgoing datagram is sent from two parts: its own header
+// and the loaded file content (or its chunk), shared by all of them.
+// Header slots are CHUNK_HEADER_LENGTH long, only a part is used
+// when not streaming.
+struct io_batch_t {
+  explicit io_batch_t(size_t size)
+      : size(size), recv_buffers(size), recv_addrs(size), recv_iovecs(size),
+        recv_msgs(size), send_headers(size * CHUNK_HEADER_LENGTH),
+        send_addrs(size), send_iovecs(2 * size), send_msgs(size),
+        send_clients(size), send_seqs(size), send_chunks(size) {}
+
+  size_t size;
+
+  vector<received_datagram_t> recv_buffers;
+  vector<struct sockaddr_in> recv_addrs;
+  vector<struct iovec> recv_iovecs;
+  vector<struct mmsghdr> recv_msgs;
+
+  vector<char> send_headers;
+  vector<struct sockaddr_in> send_addrs;
+  vector<struct iovec> send_iovecs;
+  vector<struct mmsghdr> send_msgs;
+  // Which client (index in the registry) and which queued datagram
+  // each message is for.
+  vector<size_t> send_clients;
+  vector<uint64_t> send_seqs;
+  vector<uint32_t> send_chunks;
+  // Versions of the file the batch points into, kept loaded until
+  // the batch is filled again (sends may still be in flight).
+  vector<payload_ref_t> send_payloads;
+};
+
+// Options from the command line.
+struct config_t {
+  uint16_t port;
+  size_t batch_size;
+  long workers;
+  bool use_uring;
+  // Multicast group every datagram is sent to, ss_family is AF_UNSPEC if none.
+  struct sockaddr_storage multicast_group;
+  socklen_t multicast_group_len;
+  // Limits of bytes sent per second because of received datagrams,
+  // in total and per source address, 0 if unlimited. The total limit is
+  // split between shards, the per-source one isn't: every shard keeps its
+  // own per-source buckets, so a source whose datagrams (e.g. from many
+  // ports) reach all shards can make the server send workers times as much.
+  uint64_t egress_rate;
+  uint64_t source_egress_rate;
+  // In streaming mode the file is sent in chunks of this size, 0 if not.
+  size_t chunk_size;
+  uint64_t stream_rate;
+  // Other servers of the mesh and the id of this one (random).
+  vector<struct sockaddr_in> peers;
+  uint32_t node_id;
+};
+
+// State of one relay loop. By default there is only one; with -w n there
+// are n of them in separate threads, each with its own socket bound to
+// the same port (SO_REUSEPORT), so the kernel spreads clients between them.
+// Every shard fans out the datagrams it received to all clients,
+// learning about clients of other shards from the shared registration log.
+struct shard_t {
+  shard_t(const config_t &config, uint16_t index, int sock,
+          int multicast_sock, payload_source_t &payload_source,
+          registration_log_t *log)
+      : config(config), index(index), sock(sock), batch(config.batch_size),
+        payload_source(payload_source),
+        payload_generation(payload_source.generation()),
+        payload(payload_source.current()),
+        log(log), log_pos(log == NULL ? 0 : log->end()),
+        multicast_sock(multicast_sock), multicast_batch(config.batch_size),
+        multicast_seq(0), multicast_chunk(0), paced(false),
+        // The total limit is split evenly between shards.
+        budget(config.egress_rate / config.workers, config.source_egress_rate),
+        reported_shed(0), last_report(0),
+        peers(config.peers.begin(), config.peers.end()),
+        peer_datagrams(config.batch_size), peer_iovecs(config.batch_size),
+        peer_msgs(config.batch_size), peer_seqs(config.batch_size) {
+    multicast_pace.tokens = 0;
+    multicast_pace.last_us = 0;
+  }
+
+  const config_t &config;
+  uint16_t index;
+  int sock;
+  io_batch_t batch;
+  datagram_queue_t queue;
+  client_registry_t clients;
+  // Current version of the file, appended to newly received datagrams.
+  payload_source_t &payload_source;
+  uint64_t payload_generation;
+  payload_ref_t payload;
+  registration_log_t *log; // NULL when there is only one shard
+  uint64_t log_pos;
+
+  int multicast_sock; // -1 when multicast is off
+  io_batch_t multicast_batch;
+  uint64_t multicast_seq; // next datagram to send to the group
+  uint32_t multicast_chunk;
+  token_bucket_t multicast_pace;
+
+  // Set when a chunk was held back by pacing, the loop has to wake up soon.
+  bool paced;
+
+  egress_budget_t budget;
+  uint64_t reported_shed; // shed datagrams already reported
+  time_t last_report;
+
+  // Every peer has its own cursor in the queue, datagrams are forwarded
+  // to one peer at a time from these buffers.
+  vector<peer_t> peers;
+  vector<peer_datagram_t> peer_datagrams;
+  vector<struct iovec> peer_iovecs;
+  vector<struct mmsghdr> peer_msgs;
+  vector<uint64_t> peer_seqs;
+};
+
+// Number of datagrams a queued datagram with the given payload is sent as:
+// one, or in streaming mode one per chunk of the file (at least one,
+// even for an empty file).
+uint32_t chunk_count(const shard_t &shard, const payload_t &payload) {
+  size_t chunk_size = shard.config.chunk_size;
+  if (chunk_size == 0 || payload.length == 0)
+    return 1;
+  return (uint32_t) ((payload.length + chunk_size - 1) / chunk_size);
+}
+
+// Takes the new version of the file if it was reloaded.
+void refresh_payload(shard_t &shard) {
+  uint64_t generation = shard.payload_source.generation();
+  if (generation == shard.payload_generation)
+    return;
+  shard.payload_generation = generation;
+  shard.payload = shard.payload_source.current();
+}
+
+// Length of the header in front of the file content in every datagram.
+size_t header_length(const shard_t &shard) {
+  return shard.config.chunk_size == 0 ? HEADER_LENGTH : CHUNK_HEADER_LENGTH;
+}
+
+atomic<bool> finish(false);
+// Messages about every datagram go through here, not straight to stderr.
+logger_t event_log(STDERR_FILENO);
 
 static void catch_int(int sig) {
   finish = true;
   fprintf(stderr, "\nSignal %d catched, closing.\n", sig);
 }
 
-int main(int argc, char *argv[]) {
+// Returns false if sending a datagram from the given source to local clients
+// (and, if it came from a client, to peers) doesn't fit the egress budget.
+// Datagrams of peers are relayed on behalf of many clients, so they're
+// only charged to the total budget, not to the peer as a source (their
+// senders were already charged by the server they connected to).
+bool within_budget(shard_t &shard, in_addr_t source, bool forwarded) {
+  if (!shard.budget.enabled())
+    return true;
+  // Everything this datagram will make the server send: a copy for every
+  // client not listening on the multicast group, and one for the group.
+  uint64_t recipients =
+      shard.clients.unicast_size() + (shard.multicast_sock >= 0 ? 1 : 0);
+  uint64_t cost = (header_length(shard) * chunk_count(shard, *shard.payload)
+                   + shard.payload->length) * recipients;
+  if (forwarded)
+    cost += sizeof(peer_datagram_t) * shard.peers.size();
+  return shard.budget.allow(source, cost, monotonic_us(), forwarded);
+}
 
-  if (argc != 3)
-    fatal("Usage: %s port filename", argv[0]);
-  long port_long = strtol(argv[1], NULL, 10);
-  if (errno == ERANGE || port_long <= 0 || port_long > UINT16_MAX)
-    fatal("\"%s\" is not a valid and positive uint16_t", argv[1]);
-  uint16_t port = (uint16_t) port_long;
+// Puts a datagram forwarded by a peer into the queue, for local clients only.
+// Datagrams which started at this server or came out of order are dropped.
+void handle_peer(shard_t &shard, peer_t &peer, const peer_datagram_t &recv,
+                 size_t recv_size) {
+  in_addr_t addr = peer.addr.sin_addr.s_addr;
+  in_port_t port = peer.addr.sin_port;
+  if (recv_size != sizeof(peer_datagram_t) || ntohl(recv.magic) != PEER_MAGIC) {
+    event_log.log(LOG_PEER_INVALID, addr, port);
+    return;
+  }
+  uint32_t origin = ntohl(recv.origin);
+  if (origin == shard.config.node_id)
+    return;
+  if (origin != peer.origin) {
+    // The peer was (re)started, its numbering starts again.
+    peer.origin = origin;
+    peer.expected.assign(PEER_STREAMS, 0);
+  }
+  uint64_t &expected = peer.expected[ntohs(recv.stream) % PEER_STREAMS];
+  uint64_t seq = bswap_64(recv.seq);
+  if (seq < expected) {
+    ++peer.late;
+    event_log.log(LOG_PEER_LATE, addr, port, 1, peer.late);
+    return;
+  }
+  if (seq > expected) {
+    peer.lost += seq - expected;
+    event_log.log(LOG_PEER_LOST, addr, port, seq - expected, peer.lost);
+  }
+  expected = seq + 1;
+  if (!within_budget(shard, peer.addr.sin_addr.s_addr, false))
+    return;
 
-  FILE* input_file = fopen(argv[2], "r");
-  if (input_file == NULL)
-    fatal("error opening file \"%s\"", argv[2]);
+  event_log.log(LOG_PEER_RECEIVED, addr, port);
+  queued_datagram_t datagram;
+  datagram.timestamp = recv.timestamp;
+  datagram.c = recv.c;
+  datagram.sender_addr = peer.addr.sin_addr.s_addr;
+  datagram.sender_port = peer.addr.sin_port;
+  datagram.from_peer = true;
+  datagram.payload = shard.payload;
+  shard.queue.push(datagram);
+}
 
-  datagram_with_file_t send_buffer;
+// Registers the sender of a received datagram and puts it into the queue.
+// Senders marked with MULTICAST_FLAG listen on the multicast group,
+// so they don't get unicast copies. Datagrams over the egress budget
+// are dropped right away, without registering their sender.
+void handle_received(shard_t &shard, const struct sockaddr_in &from,
+                     const received_datagram_t &received, size_t recv_size,
+                     time_t current_time) {
+  if (!shard.peers.empty()) {
+    peer_t *peer = find_peer(shard.peers, from);
+    if (peer != NULL) {
+      handle_peer(shard, *peer, received.peer, recv_size);
+      return;
+    }
+  }
+  const small_datagram_t &recv_buffer = received.client;
+  if (!within_budget(shard, from.sin_addr.s_addr, true))
+    return;
 
-  size_t file_length = fread(
-      send_buffer.file_content, sizeof(char), MAX_FILE_LENGTH, input_file);
-  fclose(input_file);
-  send_buffer.file_content[file_length] = 0;
-  size_t send_buffer_size = sizeof(uint64_t) + sizeof(char) + file_length;
+  event_log.log(LOG_RECEIVED, from.sin_addr.s_addr, from.sin_port);
+  printf("%" PRIu64 " %c\n",
+         bswap_64(recv_buffer.timestamp),
+         recv_buffer.c);
 
-  send_buffer.timestamp = 42;
-  send_buffer.c = 'A';
+  bool multicast = shard.multicast_sock >= 0 && recv_size > HEADER_LENGTH
+                   && ((const char *) &recv_buffer)[HEADER_LENGTH]
+                      == MULTICAST_FLAG;
+  client_t *known = shard.clients.find(from.sin_addr.s_addr, from.sin_port);
+  if (shard.log != NULL
+      && (known == NULL || known->last_active != current_time))
+    // Let other shards know, once per second is enough for them.
+    shard.log->publish(from.sin_addr.s_addr, from.sin_port, current_time,
+                       multicast);
+  bool created;
+  client_t &sender = shard.clients.touch(
+      from.sin_addr.s_addr, from.sin_port, current_time, created);
+  if (created)
+    // New (or returning) client gets only datagrams received from now on.
+    sender.next_seq = shard.queue.end();
+  shard.clients.set_multicast(sender, multicast);
 
-  small_datagram_t recv_buffer;
+  queued_datagram_t datagram;
+  datagram.timestamp = bswap_64((uint64_t) current_time);
+  datagram.c = recv_buffer.c;
+  datagram.sender_addr = from.sin_addr.s_addr;
+  datagram.sender_port = from.sin_port;
+  datagram.from_peer = false;
+  datagram.payload = shard.payload;
+  shard.queue.push(datagram);
+}
 
-  if (signal(SIGINT, catch_int) == SIG_ERR) {
-    syserr("Unable to change signal handler");
-    exit(EXIT_FAILURE);
+// Receives all waiting datagrams (up to RECV_BUDGET), batch.size at a time,
+// registers their senders and puts them into the queue.
+void receive_queued(shard_t &shard) {
+  io_batch_t &batch = shard.batch;
+  for (size_t received = 0; received < RECV_BUDGET; ) {
+    for (size_t i = 0; i < batch.size; ++i) {
+      batch.recv_iovecs[i].iov_base = &batch.recv_buffers[i];
+      batch.recv_iovecs[i].iov_len = sizeof(received_datagram_t);
+      memset(&batch.recv_msgs[i], 0, sizeof(struct mmsghdr));
+      batch.recv_msgs[i].msg_hdr.msg_name = &batch.recv_addrs[i];
+      batch.recv_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      batch.recv_msgs[i].msg_hdr.msg_iov = &batch.recv_iovecs[i];
+      batch.recv_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int recv_count = recvmmsg(shard.sock, batch.recv_msgs.data(),
+                              (unsigned int) batch.size, MSG_DONTWAIT, NULL);
+    if (recv_count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    checkerr(recv_count, "recvmmsg");
+
+    time_t current_time = time(NULL);
+    for (int i = 0; i < recv_count; ++i)
+      handle_received(shard, batch.recv_addrs[i], batch.recv_buffers[i],
+                      batch.recv_msgs[i].msg_len, current_time);
+
+    received += recv_count;
+    if ((size_t) recv_count < batch.size)
+      // Nothing more is waiting.
+      return;
+  }
+}
+
+// In streaming mode, returns false if the receiver paced by the given bucket
+// has to wait before it gets its next chunk.
+bool pace_allows(shard_t &shard, token_bucket_t &pace, uint64_t now_us) {
+  if (shard.config.chunk_size == 0)
+    return true;
+  double burst = (double) max(shard.config.chunk_size,
+                              (size_t) STREAM_BURST);
+  if (pace.last_us == 0) {
+    pace.tokens = burst;
+    pace.last_us = now_us;
   }
+  pace.refill(shard.config.stream_rate, now_us, burst);
+  if (pace.tokens >= 0)
+    return true;
+  shard.paced = true;
+  return false;
+}
 
-	int sock = socket(AF_INET, SOCK_DGRAM, 0); // creating IPv4 UDP socket
-	checkerr(sock, "socket");
+// Takes (or with a negative number, gives back) tokens for message i
+// of the batch from the bucket pacing its receiver.
+void charge_pace(const shard_t &shard, token_bucket_t &pace,
+                 const io_batch_t &batch, size_t i, double sign) {
+  if (shard.config.chunk_size == 0)
+    return;
+  const struct iovec *iov = &batch.send_iovecs[2 * i];
+  pace.tokens -= sign * (double) (iov[0].iov_len + iov[1].iov_len);
+}
 
-	struct sockaddr_in server_address;
-	server_address.sin_family = AF_INET;
-	server_address.sin_addr.s_addr = htonl(INADDR_ANY);
-	server_address.sin_port = htons(port);
-  checkerr(bind(sock, (struct sockaddr *) &server_address,
-			(socklen_t) sizeof(server_address)), "bind");
+// Prepares message i of the batch: the given chunk of queued datagram seq
+// (the whole file if not streaming), to the given address.
+void prepare_message(const shard_t &shard, io_batch_t &batch, size_t i,
+                     uint64_t seq, uint32_t chunk,
+                     const void *to, socklen_t to_len) {
+  const queued_datagram_t &datagram = shard.queue.at(seq);
+  const payload_t &payload = *datagram.payload;
+  char *header = &batch.send_headers[i * CHUNK_HEADER_LENGTH];
+  memcpy(header, &datagram.timestamp, sizeof(uint64_t));
+  header[sizeof(uint64_t)] = datagram.c;
+
+  struct iovec *iov = &batch.send_iovecs[2 * i];
+  iov[0].iov_base = header;
+  iov[0].iov_len = header_length(shard);
+  iov[1].iov_base = (void *) payload.content;
+  iov[1].iov_len = payload.length;
+
+  if (shard.config.chunk_size != 0) {
+    chunk_header_t chunk_header;
+    chunk_header.message_id = htonl((uint32_t) seq);
+    chunk_header.chunk = htonl(chunk);
+    chunk_header.chunk_count = htonl(chunk_count(shard, payload));
+    memcpy(header + HEADER_LENGTH, &chunk_header, sizeof(chunk_header));
+    size_t offset = (size_t) chunk * shard.config.chunk_size;
+    iov[1].iov_base = (void *) (payload.content + offset);
+    iov[1].iov_len = min(shard.config.chunk_size, payload.length - offset);
+  }
+
+  struct msghdr &msg = batch.send_msgs[i].msg_hdr;
+  memset(&batch.send_msgs[i], 0, sizeof(struct mmsghdr));
+  msg.msg_name = (void *) to;
+  msg.msg_namelen = to_len;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+}
+
+// Moves a cursor from the given chunk of queued datagram seq to the next
+// message to send (the next datagram, if not streaming).
+void advance(const shard_t &shard, uint64_t &seq, uint32_t &chunk) {
+  if (++chunk == chunk_count(shard, *shard.queue.at(seq).payload)) {
+    ++seq;
+    chunk = 0;
+  }
+}
+
+// Fills the batch with queued datagrams for registered clients, one datagram
+// per client at a time, so that every client's queue drains at a similar
+// pace (in streaming mode this paces chunks of big files between clients).
+// Each client gets datagrams in the order they were received, except
+// the ones it sent itself. Cursors are advanced as if everything will be sent.
+// With one_pass, every client gets at most one datagram in the batch.
+// Sets pending if there are still datagrams waiting after this batch.
+size_t fill_batch(shard_t &shard, bool one_pass, bool &pending) {
+  io_batch_t &batch = shard.batch;
+  const datagram_queue_t &queue = shard.queue;
+  client_registry_t &clients = shard.clients;
+  uint64_t now_us = monotonic_us();
+  size_t count = 0;
+  batch.send_payloads.clear();
+  pending = true;
+  bool first_pass = true;
+  while (pending && count < batch.size && (first_pass || !one_pass)) {
+    pending = false;
+    first_pass = false;
+    for (size_t i = 0; i < clients.size(); ++i) {
+      if (count == batch.size) {
+        pending = true;
+        break;
+      }
+      client_t &state = clients[i];
+      if (state.multicast)
+        continue;
+      // Datagrams overwritten in the ring are lost for this client.
+      if (state.next_seq < queue.oldest()) {
+        state.next_seq = queue.oldest();
+        state.next_chunk = 0;
+      }
+      // Skip datagrams sent by this client.
+      while (state.next_seq < queue.end()
+             && queue.at(state.next_seq).sender_addr == state.addr
+             && queue.at(state.next_seq).sender_port == state.port) {
+        ++state.next_seq;
+        state.next_chunk = 0;
+      }
+      if (state.next_seq == queue.end()
+          || !pace_allows(shard, state.pace, now_us))
+        continue;
+
+      struct sockaddr_in &to = batch.send_addrs[count];
+      memset(&to, 0, sizeof(to));
+      to.sin_family = AF_INET;
+      to.sin_addr.s_addr = state.addr;
+      to.sin_port = state.port;
+      prepare_message(shard, batch, count, state.next_seq, state.next_chunk,
+                      &to, sizeof(to));
+      charge_pace(shard, state.pace, batch, count, 1);
+      const payload_ref_t &payload = queue.at(state.next_seq).payload;
+      if (batch.send_payloads.empty() || batch.send_payloads.back() != payload)
+        batch.send_payloads.push_back(payload);
+
+      batch.send_clients[count] = i;
+      batch.send_seqs[count] = state.next_seq;
+      batch.send_chunks[count] = state.next_chunk;
+      ++count;
+      advance(shard, state.next_seq, state.next_chunk);
+      pending = pending || state.next_seq < queue.end();
+    }
+  }
+  return count;
+}
+
+void log_sent(const struct sockaddr_in &to) {
+  event_log.log(LOG_SENT, to.sin_addr.s_addr, to.sin_port);
+}
+
+// Sends every queued datagram once to the multicast group.
+// Returns true if there are still datagrams waiting to be sent.
+bool send_multicast(shard_t &shard) {
+  if (shard.multicast_sock < 0)
+    return false;
+  io_batch_t &batch = shard.multicast_batch;
+  const datagram_queue_t &queue = shard.queue;
+  if (shard.multicast_seq < queue.oldest()) {
+    shard.multicast_seq = queue.oldest();
+    shard.multicast_chunk = 0;
+  }
+
+  uint64_t now_us = monotonic_us();
+  while (shard.multicast_seq < queue.end()) {
+    size_t count = 0;
+    uint64_t seq = shard.multicast_seq;
+    uint32_t chunk = shard.multicast_chunk;
+    while (count < batch.size && seq < queue.end()
+           && pace_allows(shard, shard.multicast_pace, now_us)) {
+      prepare_message(shard, batch, count, seq, chunk,
+                      &shard.config.multicast_group,
+                      shard.config.multicast_group_len);
+      charge_pace(shard, shard.multicast_pace, batch, count, 1);
+      ++count;
+      advance(shard, seq, chunk);
+    }
 
-  struct pollfd recv_pollfd;
-  recv_pollfd.fd = sock;
-  recv_pollfd.events = POLLIN;
-  recv_pollfd.revents = 0;
+    if (count == 0)
+      // Held back by pacing.
+      return false;
 
-  map<pair<in_addr_t, in_port_t>, time_t> client_map;
+    int sent_count = sendmmsg(shard.multicast_sock, batch.send_msgs.data(),
+                              (unsigned int) count, 0);
+    if (sent_count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      sent_count = 0;
+    checkerr(sent_count, "sendmmsg multicast");
+    for (size_t i = (size_t) sent_count; i < count; ++i)
+      charge_pace(shard, shard.multicast_pace, batch, i, -1);
+    for (int i = 0; i < sent_count; ++i)
+      event_log.log(LOG_SENT_MULTICAST);
+
+    for (int i = 0; i < sent_count; ++i)
+      advance(shard, shard.multicast_seq, shard.multicast_chunk);
+    if ((size_t) sent_count < count)
+      return true;
+  }
+  return false;
+}
+
+// Forwards datagrams received from local clients to every peer, numbered
+// separately for each of them. Returns true if there are still datagrams
+// waiting to be forwarded.
+bool send_peers(shard_t &shard) {
+  const datagram_queue_t &queue = shard.queue;
+  bool pending = false;
+  for (peer_t &peer : shard.peers) {
+    if (peer.next_seq < queue.oldest())
+      peer.next_seq = queue.oldest();
+    while (peer.next_seq < queue.end()) {
+      size_t count = 0;
+      uint64_t seq = peer.next_seq;
+      for (; seq < queue.end() && count < shard.peer_msgs.size(); ++seq) {
+        const queued_datagram_t &queued = queue.at(seq);
+        if (queued.from_peer)
+          continue;
+        peer_datagram_t &out = shard.peer_datagrams[count];
+        out.magic = htonl(PEER_MAGIC);
+        out.origin = htonl(shard.config.node_id);
+        out.stream = htons(shard.index);
+        out.seq = bswap_64(peer.forwarded + count);
+        out.timestamp = queued.timestamp;
+        out.c = queued.c;
+
+        shard.peer_iovecs[count].iov_base = &out;
+        shard.peer_iovecs[count].iov_len = sizeof(out);
+        memset(&shard.peer_msgs[count], 0, sizeof(struct mmsghdr));
+        struct msghdr &msg = shard.peer_msgs[count].msg_hdr;
+        msg.msg_name = &peer.addr;
+        msg.msg_namelen = sizeof(peer.addr);
+        msg.msg_iov = &shard.peer_iovecs[count];
+        msg.msg_iovlen = 1;
+        shard.peer_seqs[count] = seq;
+        ++count;
+      }
+      if (count == 0) {
+        peer.next_seq = seq;
+        break;
+      }
+
+      // The socket is blocking with io_uring, but this may not wait.
+      int sent_count = sendmmsg(shard.sock, shard.peer_msgs.data(),
+                                (unsigned int) count, MSG_DONTWAIT);
+      if (sent_count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        sent_count = 0;
+      checkerr(sent_count, "sendmmsg peer");
+      peer.forwarded += sent_count;
+      if ((size_t) sent_count < count) {
+        peer.next_seq = shard.peer_seqs[sent_count];
+        pending = true;
+        break;
+      }
+      peer.next_seq = seq;
+    }
+  }
+  return pending;
+}
+
+// Sends queued datagrams to registered clients with sendmmsg.
+// Returns true if there are still datagrams waiting to be sent.
+bool send_queued(shard_t &shard) {
+  io_batch_t &batch = shard.batch;
+  client_registry_t &clients = shard.clients;
+  size_t sent = 0;
+  while (sent < SEND_BUDGET) {
+    bool pending;
+    size_t count = fill_batch(shard, false, pending);
+    if (count == 0)
+      return false;
+
+    int sent_count = sendmmsg(shard.sock, batch.send_msgs.data(),
+                              (unsigned int) count, 0);
+    if (sent_count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      sent_count = 0;
+    checkerr(sent_count, "sendmmsg");
+
+    for (int i = 0; i < sent_count; ++i)
+      log_sent(batch.send_addrs[i]);
+    // Datagrams that didn't fit into the socket buffer will be sent again,
+    // going backwards leaves every client at its earliest unsent one.
+    for (size_t i = count; i > (size_t) sent_count; --i) {
+      client_t &client = clients[batch.send_clients[i - 1]];
+      client.next_seq = batch.send_seqs[i - 1];
+      client.next_chunk = batch.send_chunks[i - 1];
+      charge_pace(shard, client.pace, batch, i - 1, -1);
+    }
+
+    sent += sent_count;
+    if ((size_t) sent_count < count)
+      // Socket buffer is full, wait for POLLOUT.
+      return true;
+    if (!pending)
+      return false;
+  }
+  return true;
+}
+
+// Prints how many datagrams were dropped by the egress budget,
+// at most once per second and only if it changed.
+void report_shed(shard_t &shard, time_t current_time) {
+  if (shard.budget.shed_datagrams_count() == shard.reported_shed
+      || current_time == shard.last_report)
+    return;
+  shard.reported_shed = shard.budget.shed_datagrams_count();
+  shard.last_report = current_time;
+  fprintf(stderr, "Over egress budget, dropped %" PRIu64 " datagrams "
+          "(%" PRIu64 " bytes of fan-out) so far\n",
+          shard.budget.shed_datagrams_count(),
+          shard.budget.shed_bytes_count());
+}
+
+// Registers clients that were seen by other shards.
+void read_registrations(shard_t &shard) {
+  registration_t registration;
+  while (shard.log->read(shard.log_pos, registration)) {
+    client_t *known = shard.clients.find(registration.addr, registration.port);
+    if (known != NULL && known->last_active >= registration.time)
+      continue;
+    bool created;
+    client_t &client = shard.clients.touch(
+        registration.addr, registration.port, registration.time, created);
+    if (created)
+      client.next_seq = shard.queue.end();
+    shard.clients.set_multicast(client, registration.multicast);
+  }
+}
+
+void run_shard_poll(shard_t *shard) {
+  // The second descriptor is only used with multicast.
+  struct pollfd pollfds[2];
+  pollfds[0].fd = shard->sock;
+  pollfds[1].fd = shard->multicast_sock;
+  nfds_t nfds = shard->multicast_sock >= 0 ? 2 : 1;
+  bool sending_pending = false, multicast_pending = false;
 
   while (true) {
-    recv_pollfd.revents = 0;
+    pollfds[0].revents = pollfds[1].revents = 0;
+    pollfds[0].events = (short) (POLLIN | (sending_pending ? POLLOUT : 0));
+    pollfds[1].events = (short) (multicast_pending ? POLLOUT : 0);
 
     if (finish) {
-      checkerr(close(sock), "close");
+      checkerr(close(shard->sock), "close");
+      if (shard->multicast_sock >= 0)
+        checkerr(close(shard->multicast_sock), "close");
       break;
     }
 
-    checkerr(poll(&recv_pollfd, 1, 5000), "poll");
-
-    if (recv_pollfd.revents & POLLIN) {
-      struct sockaddr_in from;
-      socklen_t fromlen = sizeof(from);
-      ssize_t recv_size = recvfrom(
-          recv_pollfd.fd, &recv_buffer, sizeof(recv_buffer), 0,
-          (struct sockaddr*) &from, &fromlen);
-      checkerr((int) recv_size, "recvfrom");
-
-      char str[INET_ADDRSTRLEN];
-      fprintf(stderr, "Received from %s:%d\n",
-              inet_ntop(AF_INET, &from.sin_addr, str, INET_ADDRSTRLEN),
-              ntohs(from.sin_port));
-      printf("%" PRIu64 " %c\n",
-             bswap_64(recv_buffer.timestamp),
-             recv_buffer.c);
-
-      time_t current_time = time(NULL);
-      client_map[make_pair(from.sin_addr.s_addr, from.sin_port)] = current_time;
-
-      send_buffer.c = recv_buffer.c;
-      send_buffer.timestamp = bswap_64((uint64_t) current_time);
-
-      for (auto client : client_map) {
-        if (client.first != make_pair(from.sin_addr.s_addr, from.sin_port)
-            && difftime(current_time, client.second) <= 120.0) {
-
-          struct sockaddr_in to;
-          socklen_t to_len = sizeof(to);
-          to.sin_family = AF_INET;
-          to.sin_addr.s_addr = client.first.first;
-          to.sin_port = client.first.second;
-          for (int i = 0; i < 8; ++i)
-            to.sin_zero[i] = 0;
-
-          char str2[INET_ADDRSTRLEN];
-          fprintf(stderr, "Sending to %s:%d\n",
-                  inet_ntop(AF_INET, &to.sin_addr, str2, INET_ADDRSTRLEN),
-                  ntohs(to.sin_port));
-
-          checkerr((int)sendto(recv_pollfd.fd, &send_buffer, send_buffer_size,
-                               0, (struct sockaddr*) &to, to_len), "sendto");
+    // Shards poll more often, so that they notice clients of other shards.
+    int poll_timeout = shard->log == NULL ? 5000 : 10;
+    if (shard->paced)
+      // Paced chunks can be sent in a moment.
+      poll_timeout = 1;
+    int poll_ret = poll(pollfds, nfds, poll_timeout);
+    if (poll_ret < 0 && errno == EINTR)
+      continue;
+    checkerr(poll_ret, "poll");
+
+    refresh_payload(*shard);
+    if (pollfds[0].revents & POLLIN)
+      receive_queued(*shard);
+    if (shard->log != NULL)
+      read_registrations(*shard);
+
+    time_t current_time = time(NULL);
+    shard->clients.expire(current_time);
+    report_shed(*shard, current_time);
+    shard->paced = false;
+    multicast_pending = send_multicast(*shard);
+    sending_pending = send_peers(*shard);
+    sending_pending = send_queued(*shard) || sending_pending;
+  }
+}
+
+// Relay loop using io_uring instead of poll. Datagrams are received by one
+// multishot recvmsg request into provided buffers; fan-out of a whole batch
+// is submitted at once as sendmsg requests, in the same system call which
+// waits for completions. A timeout request wakes the loop up periodically.
+// Returns false (before doing anything) if io_uring can't be used.
+bool run_shard_uring(shard_t *shard) {
+  uring_t ring;
+  if (!ring.init(URING_ENTRIES, URING_BUFFERS, URING_BUFFER_SIZE))
+    return false;
+
+  // The kernel fills the buffer according to this header: space for the
+  // sender's address, no control data, the rest is for the datagram.
+  struct msghdr recv_msg;
+  memset(&recv_msg, 0, sizeof(recv_msg));
+  recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+
+  struct __kernel_timespec timeout;
+  timeout.tv_sec = shard->log == NULL ? 5 : 0;
+  timeout.tv_nsec = shard->log == NULL ? 0 : 10000000;
+  if (shard->config.chunk_size != 0) {
+    // Paced chunks have to be sent every moment.
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = 1000000;
+  }
+
+  bool recv_armed = false, timeout_armed = false;
+  size_t sends_in_flight = 0;
+
+  while (true) {
+    if (finish) {
+      checkerr(close(shard->sock), "close");
+      if (shard->multicast_sock >= 0)
+        checkerr(close(shard->multicast_sock), "close");
+      return true;
+    }
+
+    if (!recv_armed) {
+      struct io_uring_sqe *sqe = ring.get_sqe();
+      sqe->opcode = IORING_OP_RECVMSG;
+      sqe->fd = shard->sock;
+      sqe->addr = (__u64) (uintptr_t) &recv_msg;
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = 0;
+      sqe->user_data = URING_RECV;
+      recv_armed = true;
+    }
+    if (!timeout_armed) {
+      struct io_uring_sqe *sqe = ring.get_sqe();
+      sqe->opcode = IORING_OP_TIMEOUT;
+      sqe->fd = -1;
+      sqe->addr = (__u64) (uintptr_t) &timeout;
+      sqe->len = 1;
+      sqe->user_data = URING_TIMEOUT;
+      timeout_armed = true;
+    }
+    // Peers are few, their datagrams are sent right away.
+    send_peers(*shard);
+    if (sends_in_flight == 0) {
+      // Every client gets at most one datagram per batch, so that
+      // datagrams to one client can't be reordered by the kernel.
+      bool pending;
+      sends_in_flight = fill_batch(*shard, true, pending);
+      for (size_t i = 0; i < sends_in_flight; ++i) {
+        struct io_uring_sqe *sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = shard->sock;
+        sqe->addr = (__u64) (uintptr_t) &shard->batch.send_msgs[i].msg_hdr;
+        sqe->user_data = URING_SEND + i;
+      }
+    }
+
+    int enter_ret = ring.submit_and_wait(1);
+    if (enter_ret < 0 && errno == EINTR)
+      continue;
+    checkerr(enter_ret, "io_uring_enter");
+    refresh_payload(*shard);
+
+    time_t current_time = time(NULL);
+    struct io_uring_cqe cqe;
+    while (ring.pop_cqe(cqe)) {
+      if (cqe.user_data == URING_RECV) {
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+          // The kernel stopped the multishot request, it has to be rearmed.
+          recv_armed = false;
+        if (cqe.res == -ENOBUFS)
+          // All buffers were used, they will be back after this loop.
+          continue;
+        if (cqe.res < 0) {
+          errno = -cqe.res;
+          syserr("recvmsg");
         }
+        uint16_t buffer_id = (uint16_t) (cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        char *buffer = ring.buffer(buffer_id);
+        struct io_uring_recvmsg_out out;
+        memcpy(&out, buffer, sizeof(out));
+        struct sockaddr_in from;
+        memcpy(&from, buffer + sizeof(out), sizeof(from));
+        received_datagram_t recv_buffer;
+        memset(&recv_buffer, 0, sizeof(recv_buffer));
+        size_t payload_length = cqe.res - sizeof(out) - recv_msg.msg_namelen;
+        memcpy(&recv_buffer, buffer + sizeof(out) + recv_msg.msg_namelen,
+               min(payload_length, sizeof(recv_buffer)));
+        ring.recycle_buffer(buffer_id);
+        handle_received(*shard, from, recv_buffer, payload_length,
+                        current_time);
+      } else if (cqe.user_data == URING_TIMEOUT) {
+        timeout_armed = false;
+      } else {
+        size_t i = cqe.user_data - URING_SEND;
+        if (cqe.res < 0) {
+          errno = -cqe.res;
+          syserr("sendmsg");
+        }
+        log_sent(shard->batch.send_addrs[i]);
+        --sends_in_flight;
       }
     }
+
+    if (shard->log != NULL)
+      read_registrations(*shard);
+    shard->clients.expire(current_time);
+    report_shed(*shard, current_time);
+    // The multicast socket is non-blocking, datagrams which don't fit into
+    // its buffer are retried on the next wakeup.
+    send_multicast(*shard);
   }
+}
+
+void run_shard(shard_t *shard, bool use_uring) {
+  if (use_uring) {
+    if (run_shard_uring(shard))
+      return;
+    fprintf(stderr, "io_uring is not available, using poll.\n");
+    // The socket was opened blocking for io_uring, poll needs it
+    // non-blocking (or sending would block receiving).
+    int flags = fcntl(shard->sock, F_GETFL);
+    checkerr(flags, "fcntl");
+    checkerr(fcntl(shard->sock, F_SETFL, flags | O_NONBLOCK), "fcntl");
+  }
+  run_shard_poll(shard);
+}
+
+// Creates a UDP socket bound to the given port.
+int open_socket(uint16_t port, bool reuse_port, bool blocking) {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0); // creating IPv4 UDP socket
+  checkerr(sock, "socket");
+
+  if (reuse_port) {
+    int reuse = 1;
+    checkerr(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT,
+                        &reuse, sizeof(reuse)), "setsockopt");
+  }
+
+  struct sockaddr_in server_address;
+  server_address.sin_family = AF_INET;
+  server_address.sin_addr.s_addr = htonl(INADDR_ANY);
+  server_address.sin_port = htons(port);
+  checkerr(bind(sock, (struct sockaddr *) &server_address,
+                (socklen_t) sizeof(server_address)), "bind");
+
+  // Sending may not block receiving, so with poll the socket is non-blocking
+  // and datagrams to be sent wait in the queue. io_uring never blocks anyway,
+  // and with a blocking socket it waits for buffer space by itself.
+  if (!blocking)
+    checkerr(fcntl(sock, F_SETFL, O_NONBLOCK), "fcntl");
+  return sock;
+}
+
+// Creates a non-blocking socket for sending to the configured multicast
+// group, or returns -1 if multicast is off.
+int open_multicast_socket(const config_t &config) {
+  if (config.multicast_group.ss_family == AF_UNSPEC)
+    return -1;
+  int sock = socket(config.multicast_group.ss_family, SOCK_DGRAM, 0);
+  checkerr(sock, "socket multicast");
+  int loop = 1;
+  if (config.multicast_group.ss_family == AF_INET)
+    checkerr(setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP,
+                        &loop, sizeof(loop)), "setsockopt");
+  else
+    checkerr(setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP,
+                        &loop, sizeof(loop)), "setsockopt");
+  checkerr(fcntl(sock, F_SETFL, O_NONBLOCK), "fcntl");
+  return sock;
+}
+
+// Parses an IPv4 or IPv6 multicast group address.
+void parse_multicast_group(const char *group, uint16_t port,
+                           config_t &config) {
+  memset(&config.multicast_group, 0, sizeof(config.multicast_group));
+  struct sockaddr_in *group4 = (struct sockaddr_in *) &config.multicast_group;
+  struct sockaddr_in6 *group6 =
+      (struct sockaddr_in6 *) &config.multicast_group;
+  if (inet_pton(AF_INET, group, &group4->sin_addr) == 1
+      && IN_MULTICAST(ntohl(group4->sin_addr.s_addr))) {
+    group4->sin_family = AF_INET;
+    group4->sin_port = htons(port);
+    config.multicast_group_len = sizeof(struct sockaddr_in);
+  } else if (inet_pton(AF_INET6, group, &group6->sin6_addr) == 1
+             && IN6_IS_ADDR_MULTICAST(&group6->sin6_addr)) {
+    group6->sin6_family = AF_INET6;
+    group6->sin6_port = htons(port);
+    config.multicast_group_len = sizeof(struct sockaddr_in6);
+  } else {
+    fatal("\"%s\" is not a valid multicast group address", group);
+  }
+}
+
+uint64_t parse_rate(const char *str) {
+  char *end;
+  errno = 0;
+  unsigned long long rate = strtoull(str, &end, 10);
+  if (errno == ERANGE || *end != 0 || str[0] == '-')
+    fatal("\"%s\" is not a valid number of bytes per second", str);
+  return (uint64_t) rate;
+}
+
+uint16_t parse_port(const char *str) {
+  long port_long = strtol(str, NULL, 10);
+  if (errno == ERANGE || port_long <= 0 || port_long > UINT16_MAX)
+    fatal("\"%s\" is not a valid and positive uint16_t", str);
+  return (uint16_t) port_long;
+}
+
+// Adds a peer given as host:port (IPv4).
+void parse_peer(const char *str, config_t &config) {
+  const char *colon = strrchr(str, ':');
+  if (colon == NULL)
+    fatal("\"%s\" is not a valid peer, host:port expected", str);
+  string host(str, colon - str);
+  parse_port(colon + 1);
+
+  struct addrinfo addr_hints;
+  struct addrinfo *addr_result;
+  memset(&addr_hints, 0, sizeof(struct addrinfo));
+  addr_hints.ai_family = AF_INET;
+  addr_hints.ai_socktype = SOCK_DGRAM;
+  addr_hints.ai_protocol = IPPROTO_UDP;
+  if (getaddrinfo(host.c_str(), colon + 1, &addr_hints, &addr_result) != 0)
+    fatal("Can't resolve peer \"%s\"", str);
+  struct sockaddr_in peer;
+  memcpy(&peer, addr_result->ai_addr, sizeof(peer));
+  freeaddrinfo(addr_result);
+  config.peers.push_back(peer);
+}
+
+int main(int argc, char *argv[]) {
+  config_t config;
+  config.batch_size = DEFAULT_BATCH_SIZE;
+  config.workers = 1;
+  config.use_uring = false;
+  config.multicast_group.ss_family = AF_UNSPEC;
+  config.egress_rate = 0;
+  config.source_egress_rate = 0;
+  config.chunk_size = 0;
+  config.stream_rate = DEFAULT_STREAM_RATE;
+  // Never 0, so that it can't be confused with a peer not heard from yet.
+  config.node_id = random_device()() | 1;
+  const char *multicast_group = NULL;
+  uint16_t multicast_port = MULTICAST_PORT_DEFAULT;
+  int option;
+  while ((option = getopt(argc, argv, "b:c:e:E:m:M:p:r:uw:")) != -1) {
+    switch (option) {
+      case 'e':
+        config.egress_rate = parse_rate(optarg);
+        break;
+      case 'E':
+        config.source_egress_rate = parse_rate(optarg);
+        break;
+      case 'b':
+        config.batch_size = (size_t) strtol(optarg, NULL, 10);
+        if (errno == ERANGE || config.batch_size == 0
+            || config.batch_size > MAX_BATCH_SIZE)
+          fatal("\"%s\" is not a valid batch size (1-%d)",
+                optarg, MAX_BATCH_SIZE);
+        break;
+      case 'c':
+        config.chunk_size = (size_t) strtol(optarg, NULL, 10);
+        if (errno == ERANGE || config.chunk_size == 0
+            || config.chunk_size > MAX_CHUNK_SIZE)
+          fatal("\"%s\" is not a valid chunk size (1-%zu)",
+                optarg, MAX_CHUNK_SIZE);
+        break;
+      case 'r':
+        config.stream_rate = parse_rate(optarg);
+        if (config.stream_rate == 0)
+          fatal("Stream rate has to be positive");
+        break;
+      case 'p':
+        parse_peer(optarg, config);
+        break;
+      case 'm':
+        multicast_group = optarg;
+        break;
+      case 'M':
+        multicast_port = parse_port(optarg);
+        break;
+      case 'u':
+        config.use_uring = true;
+        break;
+      case 'w':
+        config.workers = strtol(optarg, NULL, 10);
+        if (errno == ERANGE || config.workers <= 0
+            || config.workers > MAX_WORKERS)
+          fatal("\"%s\" is not a valid number of workers (1-%d)",
+                optarg, MAX_WORKERS);
+        break;
+      default:
+        fatal(USAGE, argv[0]);
+    }
+  }
+
+  if (argc - optind != 2)
+    fatal(USAGE, argv[0]);
+  config.port = parse_port(argv[optind]);
+  if (multicast_group != NULL)
+    parse_multicast_group(multicast_group, multicast_port, config);
+  // Every shard sends its own datagrams, so chunks of messages from
+  // different shards would interleave at clients.
+  if (config.chunk_size != 0 && config.workers > 1)
+    fatal("Streaming (-c) can't be used with more than one worker");
+  // Every shard gets an equal part of the total limit, and a part of 0
+  // would mean no limit at all.
+  if (config.egress_rate != 0 && config.egress_rate < (uint64_t) config.workers)
+    fatal("Egress rate (-e) has to be at least the number of workers (%ld)",
+          config.workers);
+
+  // Only in streaming mode the whole file can be sent.
+  payload_source_t payload_source(
+      argv[optind + 1], config.chunk_size == 0 ? MAX_FILE_LENGTH : SIZE_MAX);
+
+  if (signal(SIGINT, catch_int) == SIG_ERR) {
+    syserr("Unable to change signal handler");
+    exit(EXIT_FAILURE);
+  }
+
+  event_log.start();
+  // The file is reloaded in the background whenever it changes.
+  thread watcher(&payload_source_t::watch, &payload_source, std::cref(finish));
+
+  if (config.workers == 1) {
+    shard_t shard(config, 0, open_socket(config.port, false, config.use_uring),
+                  open_multicast_socket(config), payload_source, NULL);
+    run_shard(&shard, config.use_uring);
+  } else {
+    registration_log_t *log = new registration_log_t();
+    vector<shard_t*> shards;
+    // All sockets have to be bound before any shard starts receiving.
+    for (long i = 0; i < config.workers; ++i)
+      shards.push_back(new shard_t(
+          config, (uint16_t) i,
+          open_socket(config.port, true, config.use_uring),
+          open_multicast_socket(config), payload_source, log));
+    vector<thread> threads;
+    for (shard_t *shard : shards)
+      threads.push_back(thread(run_shard, shard, config.use_uring));
+    for (thread &t : threads)
+      t.join();
+    for (shard_t *shard : shards)
+      delete shard;
+    delete log;
+  }
+
+  watcher.join();
+  event_log.stop();
 
-	return 0;
+  return 0;
 }
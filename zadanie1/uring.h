@@ -0,0 +1,172 @@
+#ifndef ZADANIE1_URING_H
+#define ZADANIE1_URING_H
+
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "err.h"
+
+// Minimal io_uring wrapper using raw system calls (liburing isn't needed).
+// Besides the submission and completion rings it sets up one ring of
+// provided buffers, which multishot receive requests take buffers from.
+class uring_t {
+ public:
+  uring_t() : ring_fd(-1) {}
+
+  ~uring_t() {
+    if (ring_fd < 0)
+      return;
+    munmap(sqes, sqes_size);
+    munmap(ring_memory, ring_size);
+    if (buffer_ring != NULL)
+      munmap(buffer_ring, buffer_ring_size);
+    delete[] buffer_memory;
+    close(ring_fd);
+  }
+
+  // Sets up rings with the given number of submission entries and
+  // buffer_count buffers of buffer_size bytes in buffer group 0.
+  // Returns false if io_uring isn't supported by the kernel.
+  bool init(unsigned entries, unsigned buffer_count, unsigned buffer_size) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring_fd < 0)
+      return false;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+      close(ring_fd);
+      ring_fd = -1;
+      return false;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(__u32);
+    size_t cq_size = params.cq_off.cqes
+                     + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring_memory = (char *) mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_fd,
+                                IORING_OFF_SQ_RING);
+    if (ring_memory == MAP_FAILED)
+      syserr("mmap io_uring");
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (struct io_uring_sqe *) mmap(
+        NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+      syserr("mmap io_uring");
+
+    sq_head = (unsigned *) (ring_memory + params.sq_off.head);
+    sq_tail = (unsigned *) (ring_memory + params.sq_off.tail);
+    sq_mask = *(unsigned *) (ring_memory + params.sq_off.ring_mask);
+    sq_array = (unsigned *) (ring_memory + params.sq_off.array);
+    cq_head = (unsigned *) (ring_memory + params.cq_off.head);
+    cq_tail = (unsigned *) (ring_memory + params.cq_off.tail);
+    cq_mask = *(unsigned *) (ring_memory + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *) (ring_memory + params.cq_off.cqes);
+    sq_entries = params.sq_entries;
+    to_submit = 0;
+
+    // Provided buffer ring, its size must be a power of two.
+    buffer_ring = NULL;
+    buffer_memory = NULL;
+    buffer_ring_entries = 1;
+    while (buffer_ring_entries < buffer_count)
+      buffer_ring_entries *= 2;
+    buffer_ring_size = buffer_ring_entries * sizeof(struct io_uring_buf);
+    void *ring = mmap(NULL, buffer_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+      syserr("mmap buffer ring");
+    // struct io_uring_buf_ring isn't usable from C++ (its flexible array
+    // gets a different offset), so the ring is used as an array of buffers
+    // whose first resv field is the tail.
+    buffer_ring = (struct io_uring_buf *) ring;
+    buffer_ring_tail = &buffer_ring[0].resv;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (__u64) (uintptr_t) buffer_ring;
+    reg.ring_entries = buffer_ring_entries;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0)
+      return false;
+
+    this->buffer_size = buffer_size;
+    buffer_memory = new char[buffer_ring_entries * buffer_size];
+    *buffer_ring_tail = 0;
+    for (unsigned i = 0; i < buffer_ring_entries; ++i)
+      recycle_buffer((uint16_t) i);
+    return true;
+  }
+
+  // Returns a cleared submission entry, or NULL if the ring is full.
+  struct io_uring_sqe *get_sqe() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *sq_tail + to_submit;
+    if (tail - head >= sq_entries)
+      return NULL;
+    struct io_uring_sqe *sqe = &sqes[tail & sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[tail & sq_mask] = tail & sq_mask;
+    ++to_submit;
+    return sqe;
+  }
+
+  // Submits prepared entries and waits for at least wait_nr completions.
+  int submit_and_wait(unsigned wait_nr) {
+    __atomic_store_n(sq_tail, *sq_tail + to_submit, __ATOMIC_RELEASE);
+    unsigned submitting = to_submit;
+    to_submit = 0;
+    return (int) syscall(__NR_io_uring_enter, ring_fd, submitting, wait_nr,
+                         wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  }
+
+  // Copies the next completion and removes it from the ring.
+  // Returns false if there are none.
+  bool pop_cqe(struct io_uring_cqe &cqe) {
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+      return false;
+    cqe = cqes[head & cq_mask];
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  char *buffer(uint16_t id) {
+    return buffer_memory + (size_t) id * buffer_size;
+  }
+
+  // Gives a buffer back to the kernel after its content was used.
+  void recycle_buffer(uint16_t id) {
+    __u16 tail = *buffer_ring_tail;
+    struct io_uring_buf &buf = buffer_ring[tail & (buffer_ring_entries - 1)];
+    buf.addr = (__u64) (uintptr_t) buffer(id);
+    buf.len = buffer_size;
+    buf.bid = id;
+    __atomic_store_n(buffer_ring_tail, (__u16) (tail + 1), __ATOMIC_RELEASE);
+  }
+
+ private:
+  int ring_fd;
+  char *ring_memory;
+  size_t ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_head, *sq_tail, *sq_array, sq_mask, sq_entries;
+  unsigned *cq_head, *cq_tail, cq_mask;
+  struct io_uring_cqe *cqes;
+  unsigned to_submit;
+
+  struct io_uring_buf *buffer_ring;
+  __u16 *buffer_ring_tail;
+  size_t buffer_ring_size;
+  unsigned buffer_ring_entries;
+  unsigned buffer_size;
+  char *buffer_memory;
+};
+
+#endif //ZADANIE1_URING_H
@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cinttypes>
+#include <ctime>
+#include <new>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "siktacka.h"
+#include "util.h"
+#include "logger.h"
+#include "game.h"
+#include "scripted.h"
+
+using namespace std;
+
+// Benchmark of the game engine, without sockets and without waiting for
+// rounds: plays seeded games between scripted players as fast as possible.
+// The same options always give the same games, so the checksum of their
+// events shows if a change of the engine changed the games.
+
+uint32_t PLAYERS = 8,
+         GAMES = 10,
+         SEED = 42;
+uint64_t MAX_ROUNDS = 10'000'000;
+GameConfig config = {800, 600, 50, 6, 0};
+
+// Allocations done by the engine (and the benchmark) while running.
+uint64_t allocations = 0, allocatedBytes = 0;
+
+void *operator new(size_t size) {
+  ++allocations;
+  allocatedBytes += size;
+  void *ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == NULL)
+    throw bad_alloc();
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+int main(int argc, char *argv[]) {
+  int option;
+  while ((option = getopt(argc, argv, "n:g:W:H:t:r:m:")) != -1) {
+    switch (option) {
+      case 'n':
+        PLAYERS = parseUInt32(optarg);
+        break;
+      case 'g':
+        GAMES = parseUInt32(optarg);
+        break;
+      case 'W':
+        config.width = parseUInt32(optarg);
+        break;
+      case 'H':
+        config.height = parseUInt32(optarg);
+        break;
+      case 't':
+        config.turningSpeed = parseUInt32(optarg);
+        break;
+      case 'r':
+        SEED = parseUInt32(optarg);
+        break;
+      case 'm':
+        MAX_ROUNDS = parseUInt32(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n players] [-g games] [-W n] [-H n]"
+                " [-t n] [-r n] [-m max_rounds]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (PLAYERS < 2)
+    fatal("At least 2 players are needed.");
+
+  fprintf(stderr,
+          "Players: %u\nGames: %u\nWidth: %u\nHeight: %u\n"
+          "Turning speed: %u\nSeed: %u\n",
+          PLAYERS, GAMES, config.width, config.height, config.turningSpeed,
+          SEED);
+
+  // Never started, so nothing is written (and records are dropped).
+  Logger log;
+  ScriptedGames games(config, PLAYERS, SEED, log);
+
+  uint64_t allocationsBefore = allocations, bytesBefore = allocatedBytes;
+  uint64_t startTime = getMonotonicTime();
+  while (games.gamesPlayed < GAMES && games.rounds < MAX_ROUNDS)
+    games.round();
+  uint64_t elapsed = getMonotonicTime() - startTime;
+
+  rusage usage;
+  checkSysError(getrusage(RUSAGE_SELF, &usage), "getrusage");
+  double seconds = elapsed / 1e6;
+  printf("Games: %u\nRounds: %" PRIu64 "\nEvents: %" PRIu64 "\n"
+         "Time: %.3f s\nRounds/s: %.0f\nEvents/s: %.0f\n"
+         "Allocations: %" PRIu64 " (%" PRIu64 " bytes)\n"
+         "Peak memory: %ld KiB\nChecksum: %08lx\n",
+         games.gamesPlayed, games.rounds, games.events, seconds,
+         games.rounds / seconds, games.events / seconds, allocations - allocationsBefore,
+         allocatedBytes - bytesBefore, usage.ru_maxrss, games.checksum);
+  exit(EXIT_SUCCESS);
+}
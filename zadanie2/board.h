@@ -0,0 +1,96 @@
+#ifndef ZADANIE2_BOARD_H
+#define ZADANIE2_BOARD_H
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// A tile is a square of TILE_SIZE x TILE_SIZE pixels, one bit each,
+// a row of the tile is one word.
+const uint32_t TILE_SIZE = 64;
+// Boards with at most this many tiles are kept as a dense array of all tiles
+// (16 MiB of bits), bigger ones only keep tiles which were written to.
+const uint64_t DENSE_BOARD_MAX_TILES = 1 << 15;
+
+class Tile {
+public:
+  uint32_t generation;  // the tile is empty if it's not the board's one
+  uint64_t rows[TILE_SIZE];
+};
+
+// Set of taken pixels. Checking and taking a pixel is one bit operation
+// in a tile. Clearing a dense board only starts a new generation: tiles of
+// earlier generations are considered empty and are zeroed when they are
+// written to for the first time. A sparse board drops all its tiles, so that
+// it only ever keeps the tiles of one game.
+class Board {
+public:
+  Board() : width(0), height(0), tilesPerRow(0), generation(0), dense(true) {}
+
+  // Empties the board, changing its size if needed.
+  void reset(uint32_t newWidth, uint32_t newHeight) {
+    if (newWidth != width || newHeight != height) {
+      width = newWidth;
+      height = newHeight;
+      tilesPerRow = (width + TILE_SIZE - 1) / TILE_SIZE;
+      uint64_t tileCount =
+          tilesPerRow * (((uint64_t) height + TILE_SIZE - 1) / TILE_SIZE);
+      dense = tileCount <= DENSE_BOARD_MAX_TILES;
+      denseTiles.clear();
+      denseTiles.shrink_to_fit();
+      if (dense)
+        denseTiles.resize(tileCount, Tile());
+      generation = 0;
+    }
+    sparseTiles.clear();
+    ++generation;
+    if (generation == 0) {
+      // Generations wrapped around, old stamps could look current again.
+      for (Tile &tile : denseTiles)
+        tile.generation = 0;
+      generation = 1;
+    }
+  }
+
+  // The pixel must be on the board.
+  bool isTaken(uint32_t x, uint32_t y) const {
+    const Tile *tile = findTile(x, y);
+    if (tile == NULL || tile->generation != generation)
+      return false;
+    return (tile->rows[y % TILE_SIZE] >> (x % TILE_SIZE)) & 1;
+  }
+
+  // The pixel must be on the board.
+  void take(uint32_t x, uint32_t y) {
+    Tile &tile = dense ? denseTiles[tileIndex(x, y)]
+                       : sparseTiles[tileIndex(x, y)];
+    if (tile.generation != generation) {
+      memset(tile.rows, 0, sizeof(tile.rows));
+      tile.generation = generation;
+    }
+    tile.rows[y % TILE_SIZE] |= ((uint64_t) 1) << (x % TILE_SIZE);
+  }
+
+private:
+  uint64_t tileIndex(uint32_t x, uint32_t y) const {
+    return (y / TILE_SIZE) * tilesPerRow + x / TILE_SIZE;
+  }
+
+  const Tile *findTile(uint32_t x, uint32_t y) const {
+    if (dense)
+      return &denseTiles[tileIndex(x, y)];
+    auto it = sparseTiles.find(tileIndex(x, y));
+    return it == sparseTiles.end() ? NULL : &it->second;
+  }
+
+  uint32_t width;
+  uint32_t height;
+  uint64_t tilesPerRow;
+  uint32_t generation;
+  bool dense;
+  std::vector<Tile> denseTiles;
+  std::unordered_map<uint64_t, Tile> sparseTiles;
+};
+
+#endif //ZADANIE2_BOARD_H
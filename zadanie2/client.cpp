@@ -29,6 +29,9 @@ const char LEFT_KEY_UP[] = "LEFT_KEY_UP";
 const char RIGHT_KEY_DOWN[] = "RIGHT_KEY_DOWN";
 const char RIGHT_KEY_UP[] = "RIGHT_KEY_UP";
 
+// Largest snapshot (before and after decompression) the client accepts.
+const uint32_t MAX_SNAPSHOT_LENGTH = 1 << 26;
+
 bool finish = false;
 
 void catchSigInt(int sig) {
@@ -38,8 +41,10 @@ void catchSigInt(int sig) {
 
 void incorrectArguments(char *argv0) {
   fprintf(stderr,
-          "Usage: %s player_name game_server_host[:port]"
-          "[ui_server_host[:port]]\n",
+          "Usage: %s [-S] player_name game_server_host[:port]"
+          "[ui_server_host[:port]]\n"
+          "  -S  download a snapshot of a game in progress instead of "
+          "all of its events\n",
           argv0);
   exit(EXIT_FAILURE);
 }
@@ -103,15 +108,175 @@ void parseNetworkAddress(char *address, addrinfo **addrResults, uint16_t *port,
   }
 }
 
+// Writes the whole message to GUI.
+void writeToGui(int fd, const string &message) {
+  size_t written = 0;
+  while (written < message.length()) {
+    ssize_t ret = write(fd, message.data() + written,
+                        message.length() - written);
+    checkSysError((int) ret, "write to GUI");
+    written += ret;
+  }
+}
+
+// Snapshot of a game being downloaded from the server, chunk by chunk.
+class SnapshotDownload {
+public:
+  uint32_t gameId;
+  uint32_t eventNumber;
+  uint32_t length;
+  uint32_t rawLength;
+  vector<uint8_t> data;
+  vector<bool> received;  // for every chunk
+  size_t missing;
+
+  SnapshotDownload()
+      : gameId(0), eventNumber(0), length(0), rawLength(0), missing(0) {}
+
+  // The first chunk which wasn't received yet.
+  uint32_t firstMissing() const {
+    for (size_t i = 0; i < received.size(); ++i)
+      if (!received[i])
+        return (uint32_t) i;
+    return 0;
+  }
+
+  bool complete() const {
+    return !received.empty() && missing == 0;
+  }
+
+  // Saves a chunk received in a datagram of the given game (chunk points
+  // right after the datagram header). Returns false if it's incorrect.
+  // A chunk of another snapshot than before starts downloading it again.
+  bool add(uint32_t chunkGameId, const uint8_t *chunk, size_t size) {
+    if (size < sizeof(SnapshotChunkHeader) + sizeof(uint32_t))
+      return false;
+    size_t dataLength = size - sizeof(SnapshotChunkHeader) - sizeof(uint32_t);
+    uint32_t crcCalculated =
+        (uint32_t) crc32(0, chunk, (uInt) (size - sizeof(uint32_t)));
+    uint32_t crcDownloaded =
+        ntohl(*((uint32_t *) (chunk + size - sizeof(uint32_t))));
+    if (crcCalculated != crcDownloaded)
+      return false;
+
+    const SnapshotChunkHeader *header = (const SnapshotChunkHeader *) chunk;
+    uint32_t chunkEventNumber = ntohl(header->eventNumber);
+    uint32_t chunkLength = ntohl(header->length);
+    uint32_t chunkRawLength = ntohl(header->rawLength);
+    uint32_t offset = ntohl(header->offset);
+    if (chunkLength == 0 || chunkLength > MAX_SNAPSHOT_LENGTH
+        || chunkRawLength > MAX_SNAPSHOT_LENGTH
+        || offset >= chunkLength || offset % SNAPSHOT_CHUNK_LENGTH != 0
+        || dataLength != min(SNAPSHOT_CHUNK_LENGTH,
+                             (size_t) (chunkLength - offset)))
+      return false;
+
+    if (received.empty() || chunkGameId != gameId
+        || chunkEventNumber != eventNumber || chunkLength != length
+        || chunkRawLength != rawLength) {
+      gameId = chunkGameId;
+      eventNumber = chunkEventNumber;
+      length = chunkLength;
+      rawLength = chunkRawLength;
+      data.assign(length, 0);
+      received.assign((length + SNAPSHOT_CHUNK_LENGTH - 1)
+                      / SNAPSHOT_CHUNK_LENGTH, false);
+      missing = received.size();
+    }
+    size_t index = offset / SNAPSHOT_CHUNK_LENGTH;
+    if (!received[index]) {
+      memcpy(&data[offset], header + 1, dataLength);
+      received[index] = true;
+      --missing;
+    }
+    return true;
+  }
+};
+
+// Decompresses a downloaded snapshot and writes the game it holds as
+// messages to GUI. Returns false if the snapshot is incorrect.
+bool readSnapshot(const SnapshotDownload &snapshot, vector<string> &playerNames,
+                  uint32_t &width, uint32_t &height, string &messageToGui) {
+  vector<uint8_t> raw(snapshot.rawLength);
+  uLongf rawLength = snapshot.rawLength;
+  if (uncompress(raw.data(), &rawLength, snapshot.data.data(),
+                 snapshot.length) != Z_OK
+      || rawLength != snapshot.rawLength
+      || rawLength < sizeof(SnapshotHeader))
+    return false;
+
+  const SnapshotHeader *header = (const SnapshotHeader *) raw.data();
+  uint32_t snapshotWidth = ntohl(header->width);
+  uint32_t snapshotHeight = ntohl(header->height);
+  uint32_t playerCount = ntohl(header->playerCount);
+  uint32_t namesLength = ntohl(header->namesLength);
+  if (sizeof(SnapshotHeader) + (uint64_t) playerCount * sizeof(SnapshotPlayer)
+      + namesLength + (uint64_t) snapshotWidth * snapshotHeight != rawLength)
+    return false;
+  const SnapshotPlayer *players = (const SnapshotPlayer *) (header + 1);
+  const char *names = (const char *) (players + playerCount);
+  const uint8_t *image = (const uint8_t *) (names + namesLength);
+
+  vector<string> snapshotNames;
+  string playerNameString;
+  for (size_t i = 0; i < namesLength; ++i) {
+    if (names[i] == 0) {
+      snapshotNames.push_back(playerNameString);
+      playerNameString.clear();
+    } else {
+      playerNameString += names[i];
+    }
+  }
+  if (!playerNameString.empty() || snapshotNames.size() != playerCount)
+    return false;
+
+  char line[BUF_TO_GUI_SIZE];
+  snprintf(line, sizeof(line), "NEW_GAME %" PRIu32 " %" PRIu32 " ",
+           snapshotWidth, snapshotHeight);
+  messageToGui = line;
+  for (const string &name : snapshotNames)
+    messageToGui.append(name).append(" ");
+  messageToGui.append("\n");
+  for (uint32_t y = 0; y < snapshotHeight; ++y) {
+    for (uint32_t x = 0; x < snapshotWidth; ++x) {
+      uint8_t owner = image[(size_t) y * snapshotWidth + x];
+      if (owner == 0)
+        continue;
+      if (owner > playerCount)
+        return false;
+      snprintf(line, sizeof(line), "PIXEL %" PRIu32 " %" PRIu32 " %s\n",
+               x, y, snapshotNames[owner - 1].c_str());
+      messageToGui.append(line);
+    }
+  }
+  for (uint32_t i = 0; i < playerCount; ++i)
+    if (players[i].eliminated)
+      messageToGui.append("PLAYER_ELIMINATED ")
+          .append(snapshotNames[i]).append("\n");
+
+  playerNames = snapshotNames;
+  width = snapshotWidth;
+  height = snapshotHeight;
+  return true;
+}
+
 int main(int argc, char *argv[]) {
   // Parse command line arguments.
-  if (argc < 3 || argc > 4) {
+  bool snapshots = false;
+  int option;
+  while ((option = getopt(argc, argv, "+S")) != -1) {
+    if (option == 'S')
+      snapshots = true;
+    else
+      incorrectArguments(argv[0]);
+  }
+  if (argc - optind < 2 || argc - optind > 3) {
     fprintf(stderr, "Incorrect amount of command line arguments.\n");
     incorrectArguments(argv[0]);
   }
 
   // player_name
-  char *playerName = argv[1];
+  char *playerName = argv[optind];
   if (strlen(playerName) > PLAYER_NAME_MAX_LENGTH) {
     fprintf(stderr, "Player name \"%s\" is too long (max. 64 characters).\n",
             playerName);
@@ -135,14 +300,15 @@ int main(int argc, char *argv[]) {
   // game_server_host
   addrinfo *serverAddrInfo;
   uint16_t serverPort = 12345;
-  parseNetworkAddress(argv[2], &serverAddrInfo, &serverPort, true, "server");
+  parseNetworkAddress(argv[optind + 1], &serverAddrInfo, &serverPort, true,
+                      "server");
 
   // ui_server_host
   addrinfo *guiAddrInfo;
   uint16_t guiPort = 12346;
   char defaultgui[10] = "localhost";
-  if (argc == 4)
-    parseNetworkAddress(argv[3], &guiAddrInfo, &guiPort, true, "GUI");
+  if (argc - optind == 3)
+    parseNetworkAddress(argv[optind + 2], &guiAddrInfo, &guiPort, true, "GUI");
   else
     parseNetworkAddress(defaultgui, &guiAddrInfo, &guiPort, true, "GUI");
 
@@ -196,6 +362,11 @@ int main(int argc, char *argv[]) {
   vector<string> playerNames;
   uint32_t currentGameId = 0, width = 0, height = 0;
   set<pair<int,int>> events; // {gameId, eventNumber}
+  // Until a game is downloaded, a snapshot of it is asked for (with -S).
+  bool snapshotWanted = snapshots;
+  SnapshotDownload snapshot;
+  // Events before the snapshot were already sent to GUI.
+  uint32_t snapshotGameId = 0, snapshotEventNumber = 0;
   while (true) {
     if (finish)
       break;
@@ -204,7 +375,11 @@ int main(int argc, char *argv[]) {
     if (currentTime >= nextSendToServer) {
       // DELAY ms passed, time to send a message to server.
       sendBuf->turnDirection = turnDirection;
-      sendBuf->nextExpectedEventNumer = htonl(nextEventNumber);
+      if (snapshotWanted)
+        sendBuf->nextExpectedEventNumer =
+            htonl(SNAPSHOT_REQUEST | snapshot.firstMissing());
+      else
+        sendBuf->nextExpectedEventNumer = htonl(nextEventNumber);
       if (DEBUG)
         fprintf(stderr,
                 "Sending to server: turnDirection %" PRId8 ", "
@@ -262,6 +437,44 @@ int main(int argc, char *argv[]) {
           uint32_t gameId = ntohl(*((uint32_t *) buf));
           if (DEBUG)
             fprintf(stderr, "Game ID: %u\n", gameId);
+
+          if (recvSize - eventStart >= (ssize_t) sizeof(uint32_t)
+              && ntohl(*((uint32_t *) (buf + eventStart))) == SNAPSHOT_MARKER) {
+            // A chunk of a snapshot.
+            if (!snapshotWanted)
+              continue;
+            if (!snapshot.add(gameId, buf + eventStart,
+                              (size_t) (recvSize - eventStart))) {
+              fprintf(stderr, "Invalid snapshot chunk, ignoring.\n");
+              continue;
+            }
+            if (snapshot.complete()) {
+              string snapshotMessage;
+              if (readSnapshot(snapshot, playerNames, width, height,
+                               snapshotMessage)) {
+                fprintf(stderr, "New game (from a snapshot).\n");
+                currentGameId = gameId;
+                nextEventNumber = snapshot.eventNumber;
+                snapshotGameId = gameId;
+                snapshotEventNumber = snapshot.eventNumber;
+                writeToGui(sockets[1].fd, snapshotMessage);
+              } else {
+                fprintf(stderr, "Invalid snapshot, downloading events.\n");
+              }
+              snapshotWanted = false;
+            }
+            continue;
+          }
+          if (snapshotWanted) {
+            // Events from the beginning mean there's no snapshot. Others
+            // were meant for before the snapshot was asked for.
+            if (recvSize - eventStart >= (ssize_t) sizeof(EventHeader)
+                && ntohl(((EventHeader *) (buf + eventStart))->eventNumber)
+                   == 0)
+              snapshotWanted = false;
+            else
+              continue;
+          }
           while (eventStart < recvSize) {
             EventHeader *eventHeader = (EventHeader *) (buf + eventStart);
 
@@ -306,7 +519,9 @@ int main(int argc, char *argv[]) {
 
             bool duplicate = false;
             if (events.find({gameId, ntohl(eventHeader->eventNumber)})
-                != events.end())
+                != events.end()
+                || (gameId == snapshotGameId
+                    && ntohl(eventHeader->eventNumber) < snapshotEventNumber))
               // Event is a duplicate, don't send it to GUI.
               duplicate = true;
 
@@ -0,0 +1,51 @@
+#ifndef ZADANIE2_DIRECTIONS_H
+#define ZADANIE2_DIRECTIONS_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Angles (in degrees) in [-DIRECTION_TABLE_RANGE, DIRECTION_TABLE_RANGE)
+// have their direction precomputed.
+const int64_t DIRECTION_TABLE_RANGE = 360 * 32;
+
+class Direction {
+public:
+  long double dx;
+  long double dy;
+};
+
+// Moves of a snake by one pixel in the direction of a given angle.
+// Snakes start at a whole angle and turn by whole degrees, so their angles
+// are always integers. Angles aren't reduced modulo 360 (that would change
+// the rounding of the result), so the table keeps the exact values computed
+// for every angle near 0, and others are computed when needed.
+class DirectionTable {
+public:
+  DirectionTable() : table(2 * DIRECTION_TABLE_RANGE) {
+    for (int64_t angle = -DIRECTION_TABLE_RANGE;
+         angle < DIRECTION_TABLE_RANGE; ++angle)
+      table[angle + DIRECTION_TABLE_RANGE] = compute((long double) angle);
+  }
+
+  Direction get(long double angle) const {
+    if (angle >= -DIRECTION_TABLE_RANGE && angle < DIRECTION_TABLE_RANGE) {
+      int64_t index = (int64_t) angle;
+      if ((long double) index == angle)
+        return table[index + DIRECTION_TABLE_RANGE];
+    }
+    return compute(angle);
+  }
+
+private:
+  static Direction compute(long double angle) {
+    return Direction{std::cos(angle * M_PIl / 180.0),
+                     std::sin(angle * M_PIl / 180.0)};
+  }
+
+  std::vector<Direction> table;
+};
+
+const DirectionTable directions;
+
+#endif //ZADANIE2_DIRECTIONS_H
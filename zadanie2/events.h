@@ -0,0 +1,179 @@
+#ifndef ZADANIE2_EVENTS_H
+#define ZADANIE2_EVENTS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <zlib.h>
+
+#include "siktacka.h"
+
+// Room for events in one datagram.
+const size_t MAX_EVENTS_LENGTH =
+    MAX_DATAGRAM_SIZE - sizeof(ServerToClientDatagramHeader);
+
+// One event of the game, decoded from the log.
+struct Event {
+  EventType eventType;
+  uint8_t playerNumber;  // PIXEL, PLAYER_ELIMINATED
+  uint32_t x;  // maxx from NEW_GAME, x from PIXEL
+  uint32_t y;  // maxy from NEW_GAME, y from PIXEL
+};
+
+// Events of the current game. Every event is encoded once, when it's added,
+// in the form it's sent in (with its crc32), so that datagrams are only
+// copied from the encoded events; the few readers of single events decode
+// them. For every event it's known where a datagram starting with it ends.
+// A pixel takes 30 bytes: 22 encoded, 4 for its offset and 4 for the end of
+// its datagram, so a game filling a whole 800x600 board takes about 14 MB
+// (most games end long before). Buffers are kept between games, so after
+// the first big game appending doesn't allocate. Player names of the game
+// (from its NEW_GAME event, which is always the first one) are kept
+// separately, in the same form as in the datagram. Encoded events of a game
+// must take less than 4 GiB.
+class EventLog {
+public:
+  EventLog() : gameCount(0) {}
+
+  // Starts the log of a new game with its NEW_GAME event.
+  void newGame(uint32_t width, uint32_t height,
+               const std::vector<std::string> &names) {
+    ++gameCount;
+    playerNames.clear();
+    for (const std::string &s : names)
+      playerNames.append(s.c_str(), s.length() + 1);
+    wire.clear();
+    offsets.assign(1, 0);
+    ends.clear();
+    put(NEW_GAME, 0, width, height);
+  }
+
+  void put(EventType eventType, uint8_t playerNumber, uint32_t x, uint32_t y) {
+    encode(Event{eventType, playerNumber, x, y}, (uint32_t) size());
+  }
+
+  size_t size() const {
+    return offsets.size() - 1;
+  }
+
+  Event operator[](size_t i) const {
+    const EventHeader *header = (const EventHeader *) &wire[offsets[i]];
+    Event event{header->eventType, 0, 0, 0};
+    switch (header->eventType) {
+      case NEW_GAME: {
+        const NewGameEventData *data = (const NewGameEventData *) (header + 1);
+        event.x = ntohl(data->width);
+        event.y = ntohl(data->height);
+        break;
+      }
+      case PIXEL: {
+        const PixelEventData *data = (const PixelEventData *) (header + 1);
+        event.playerNumber = data->playerNumber;
+        event.x = ntohl(data->x);
+        event.y = ntohl(data->y);
+        break;
+      }
+      case PLAYER_ELIMINATED: {
+        const PlayerEliminatedEventData *data =
+            (const PlayerEliminatedEventData *) (header + 1);
+        event.playerNumber = data->playerNumber;
+        break;
+      }
+      default:
+        break;
+    }
+    return event;
+  }
+
+  // Number of games logged so far, so it changes with every new game.
+  uint64_t games() const {
+    return gameCount;
+  }
+
+  // Names of the players, each one followed by a null character.
+  const std::string &names() const {
+    return playerNames;
+  }
+
+  // Number of the first event which won't fit in a datagram
+  // starting with the given event.
+  size_t datagramEnd(size_t first) const {
+    return first < ends.size() ? ends[first] : size();
+  }
+
+  // Encoded events from first to end (excluding it).
+  const uint8_t *encoded(size_t first) const {
+    return &wire[offsets[first]];
+  }
+
+  size_t encodedLength(size_t first, size_t end) const {
+    return offsets[end] - offsets[first];
+  }
+
+private:
+  void encode(const Event &event, uint32_t number) {
+    size_t dataLength = 0;
+    switch (event.eventType) {
+      case NEW_GAME:
+        dataLength = sizeof(NewGameEventData) + playerNames.length(); break;
+      case PIXEL:
+        dataLength = sizeof(PixelEventData); break;
+      case PLAYER_ELIMINATED:
+        dataLength = sizeof(PlayerEliminatedEventData); break;
+      default:
+        break;
+    }
+    size_t start = wire.size();
+    size_t length = sizeof(EventHeader) + dataLength + sizeof(uint32_t);
+    wire.resize(start + length);
+
+    uint8_t *encoded = &wire[start];
+    EventHeader *header = (EventHeader *) encoded;
+    header->len = htonl((uint32_t) length - 2 * sizeof(uint32_t));
+    header->eventNumber = htonl(number);
+    header->eventType = event.eventType;
+    switch (event.eventType) {
+      case NEW_GAME: {
+        NewGameEventData *data = (NewGameEventData *) (header + 1);
+        data->width = htonl(event.x);
+        data->height = htonl(event.y);
+        memcpy(data->playerNames, playerNames.data(), playerNames.length());
+        break;
+      }
+      case PIXEL: {
+        PixelEventData *data = (PixelEventData *) (header + 1);
+        data->playerNumber = event.playerNumber;
+        data->x = htonl(event.x);
+        data->y = htonl(event.y);
+        break;
+      }
+      case PLAYER_ELIMINATED: {
+        PlayerEliminatedEventData *data =
+            (PlayerEliminatedEventData *) (header + 1);
+        data->playerNumber = event.playerNumber;
+        break;
+      }
+      default:
+        break;
+    }
+    uint32_t crc = htonl((uint32_t) crc32(0, encoded,
+                                          (uint32_t) (length - sizeof(crc))));
+    memcpy(encoded + length - sizeof(crc), &crc, sizeof(crc));
+    offsets.push_back((uint32_t) wire.size());
+
+    // Datagrams starting with events which have no room for this one
+    // end right before it.
+    while (wire.size() - offsets[ends.size()] > MAX_EVENTS_LENGTH)
+      ends.push_back(number);
+  }
+
+  uint64_t gameCount;
+  std::string playerNames;
+  std::vector<uint8_t> wire;
+  std::vector<uint32_t> offsets;  // of every event in wire, and of its end
+  std::vector<uint32_t> ends;  // datagram ends, only for full datagrams
+};
+
+#endif //ZADANIE2_EVENTS_H
@@ -0,0 +1,306 @@
+#ifndef ZADANIE2_GAME_H
+#define ZADANIE2_GAME_H
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "siktacka.h"
+#include "util.h"
+#include "logger.h"
+#include "board.h"
+#include "directions.h"
+#include "events.h"
+#include "players.h"
+
+const bool DEBUG = false;
+
+const uint64_t randConst1 = 279470273, randConst2 = 4294967291;
+
+// Settings of the games, the same in all rooms.
+class GameConfig {
+public:
+  uint32_t width;
+  uint32_t height;
+  uint32_t roundsPerSec;
+  uint32_t turningSpeed;
+  uint32_t snapshotInterval;  // 0 if snapshots are off
+};
+
+// Rules of the game: players joining, games starting and ending, snakes
+// moving and the events of all that. Doesn't send anything and doesn't
+// look at the clock, so games can be simulated without clients (the same
+// seed and inputs give the same events).
+class Game {
+public:
+  Game(const GameConfig &config, uint32_t number, uint32_t seed, Logger &log)
+      : config(config), number(number), lastRandom(seed), log(log),
+        alivePlayers(0), gameInProgress(false), gameId(0) {}
+
+  // Simulates a turn at a monotonic time (in microseconds).
+  void round(uint64_t currentTime) {
+    if (!gameInProgress) {
+      players.sort();
+      deleteInactive(currentTime);
+      if (isEveryoneReady()) {
+        // Start a new game.
+        gameId = getRandom();
+        log.log(LOG_NEW_GAME_ID, number, gameId);
+        onGameStart();
+        gameInProgress = true;
+      }
+    } else {
+      deleteInactive(currentTime);
+      for (Player &p : players) {
+        if (p.hasSnake) {
+          moveSnake(p.snake);
+          if (alivePlayers < 2) {
+            onGameOver();
+            gameInProgress = false;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  // Handles a datagram received from a client (at a monotonic time, in
+  // microseconds), already checked to be correct.
+  void handleDatagram(const uint8_t *data, size_t size,
+                      const sockaddr_in6 &fromAddr, uint64_t receiveTime) {
+    const ClientToServerDatagram *datagram =
+        (const ClientToServerDatagram *) data;
+    size_t playerNameLen = size - sizeof(ClientToServerDatagram);
+    const char *playerName = (const char *) datagram->playerName;
+    uint64_t sessionId = be64toh(datagram->sessionId);
+
+    // A socket sending another name is another player, like a new client.
+    Player *player = players.find(fromAddr.sin6_addr, fromAddr.sin6_port,
+                                  playerName, playerNameLen);
+    bool reconnected = false;
+    if (player != NULL) {
+      // It's the same client as saved.
+      if (sessionId > player->sessionId) {
+        // Higher session ID - disconnect the old player
+        // and create a new one later.
+        players.disconnect(*player);
+        player = NULL;
+        reconnected = true;
+      } else if (sessionId < player->sessionId) {
+        // Session ID lower than saved - ignore.
+        return;
+      }
+    }
+
+    if (player == NULL) {
+      // The name of a disconnected player is taken for as long as it's kept
+      // (while its snake is in the game), only its own client can take it
+      // over with a higher session ID.
+      if (!reconnected && playerNameLen > 0
+          && players.findByName(playerName, playerNameLen) != NULL)
+        // Duplicate name of already saved client - ignoring.
+        return;
+      player = &players.add(fromAddr.sin6_addr, fromAddr.sin6_port,
+                            playerName, playerNameLen, sessionId);
+      player->ready = false;
+      player->hasSnake = false;
+    }
+
+    player->lastReceiveTime = receiveTime;
+    player->snake.turnDirection = datagram->turnDirection;
+    player->nextExpectedEvent = ntohl(datagram->nextExpectedEventNumer);
+    player->snapshotChunk = NO_SNAPSHOT_CHUNK;
+    if (player->nextExpectedEvent & SNAPSHOT_REQUEST) {
+      // Events from the beginning, unless a snapshot is sent instead.
+      player->snapshotChunk = player->nextExpectedEvent & ~SNAPSHOT_REQUEST;
+      player->nextExpectedEvent = 0;
+    }
+
+    if (!gameInProgress)
+      player->ready = player->ready || (player->snake.turnDirection != 0);
+  }
+
+  uint32_t id() const {
+    return gameId;
+  }
+
+  bool inProgress() const {
+    return gameInProgress;
+  }
+
+  // Events of the current game.
+  const EventLog &gameEvents() const {
+    return events;
+  }
+
+  PlayerDirectory &allPlayers() {
+    return players;
+  }
+
+private:
+  uint32_t getRandom() {
+    lastRandom =
+        (uint32_t) ((((uint64_t) lastRandom) * randConst1) % randConst2);
+    return (uint32_t) lastRandom;
+  }
+
+  // Starts the events of a new game.
+  void putNewGameEvent(uint32_t maxx, uint32_t maxy,
+                       const std::vector<std::string> &playerNames) {
+    log.log(LOG_NEW_GAME, number, maxx, maxy, (uint32_t) playerNames.size());
+    for (const std::string &s : playerNames)
+      log.log(LOG_PLAYER_NAME, number, 0, 0, 0, s);
+    events.newGame(maxx, maxy, playerNames);
+  }
+
+  void putPixelEvent(uint8_t playerNumber, uint32_t x, uint32_t y) {
+    if (DEBUG)
+      fprintf(stderr, "Pixel: %u %u %u\n", playerNumber, x, y);
+    events.put(PIXEL, playerNumber, x, y);
+  }
+
+  void putPlayerEliminatedEvent(uint8_t playerNumber) {
+    log.log(LOG_PLAYER_ELIMINATED, number, playerNumber);
+    events.put(PLAYER_ELIMINATED, playerNumber, 0, 0);
+  }
+
+  void putGameOverEvent() {
+    log.log(LOG_GAME_OVER, number);
+    events.put(GAME_OVER, 0, 0, 0);
+  }
+
+  bool isPixelTaken(uint32_t x, uint32_t y) {
+    return board.isTaken(x, y);
+  }
+
+  // Puts a pixel on the player's current position or eliminates them.
+  void createPixel(Snake &snake) {
+    uint32_t x = (uint32_t) snake.x, y = (uint32_t) snake.y;
+    if (snake.x < 0 || x >= config.width || snake.y < 0 || y >= config.height
+        || isPixelTaken(x,y)) {
+      // Out of bounds or pixel already taken - eliminate the player.
+      snake.alive = false;
+      --alivePlayers;
+      putPlayerEliminatedEvent(snake.number);
+    } else {
+      board.take(x, y);
+      putPixelEvent(snake.number, x, y);
+    }
+  }
+
+  void moveSnake(Snake &snake) {
+    if (!snake.alive)
+      return;
+    snake.angle += snake.turnDirection * ((long double) config.turningSpeed);
+    uint32_t oldX = (uint32_t) snake.x, oldY = (uint32_t) snake.y;
+    Direction direction = directions.get(snake.angle);
+    snake.x += direction.dx;
+    snake.y += direction.dy;
+    if ((uint32_t) snake.x != oldX || (uint32_t) snake.y != oldY)
+      createPixel(snake);
+  }
+
+  // Returns true if all (and at least two) players with a unique name are
+  // ready. If a name is duplicated, only first one on the list is checked
+  // and can play. Players have to be sorted.
+  bool isEveryoneReady() {
+    uint32_t readyPlayers = 0;
+    const char *lastName = "";
+    for (Player &p : players) {
+      if (p.nameLength > 0 && strcmp(p.name, lastName) != 0) {
+        lastName = p.name;
+        if (!p.ready) {
+          return false;
+        }
+        ++readyPlayers;
+      }
+    }
+    return readyPlayers > 1;
+  }
+
+  // Initialize snakes when a new game starts. Players have to be sorted.
+  void onGameStart() {
+    if (DEBUG)
+      fprintf(stderr, "Starting new game.\n");
+    board.reset(config.width, config.height);
+    const char *lastName = "";
+    std::vector<std::string> playerNames;
+    size_t totalPlayerNameLength = 0;
+    size_t totalNameLengthLimit =
+        MAX_DATAGRAM_SIZE - sizeof(ServerToClientDatagramHeader)
+        - sizeof(EventHeader) - sizeof(NewGameEventData) - sizeof(uint32_t);
+    alivePlayers = 0;
+    bool moreAllowed = true;
+    for (Player &p : players) {
+      p.nextExpectedEvent = 0;
+      if (p.nameLength > 0
+          && strcmp(p.name, lastName) != 0
+          && moreAllowed) {
+        totalPlayerNameLength += p.nameLength + 1;
+        if (totalPlayerNameLength <= totalNameLengthLimit) {
+          lastName = p.name;
+          playerNames.push_back(std::string(p.name, p.nameLength));
+          p.hasSnake = true;
+          p.snake.x = ((long double) (getRandom() % config.width)) + 0.5;
+          p.snake.y = ((long double) (getRandom() % config.height)) + 0.5;
+          p.snake.angle = getRandom() % 360;
+          p.snake.number = alivePlayers;
+          p.snake.alive = true;
+          ++alivePlayers;
+        } else {
+          // Total player name length too big - don't allow more players.
+          p.hasSnake = false;
+          moreAllowed = false;
+        }
+      } else {
+        p.hasSnake = false;
+      }
+    }
+    putNewGameEvent(config.width, config.height, playerNames);
+    for (Player &p : players)
+      if (p.hasSnake)
+        createPixel(p.snake);
+  }
+
+  void onGameOver() {
+    for (Player &p : players) {
+      p.hasSnake = false;
+      p.ready = false;
+    }
+    putGameOverEvent();
+  }
+
+  // Delete inactive players who don't have snakes.
+  void deleteInactive(uint64_t currentTime) {
+    for (auto p = players.begin(); p != players.end(); ) {
+      if (currentTime - p->lastReceiveTime > 2'000'000)
+        players.disconnect(*p);
+      if ((!p->hasSnake) && p->disconnected) {
+        p = players.erase(p);
+        continue;
+      }
+      ++p;
+    }
+  }
+
+  const GameConfig &config;
+  uint32_t number;
+  uint32_t lastRandom;
+  Logger &log;
+
+  // Events of the current game.
+  EventLog events;
+  // Pixels already taken by players.
+  Board board;
+  PlayerDirectory players;
+  uint8_t alivePlayers;
+  bool gameInProgress;
+  uint32_t gameId;
+};
+
+#endif //ZADANIE2_GAME_H
@@ -0,0 +1,308 @@
+#ifndef ZADANIE2_LOGGER_H
+#define ZADANIE2_LOGGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+
+#include "siktacka.h"
+
+// Number of records in the ring, must be a power of two.
+const size_t LOG_RING_SIZE = 4096;
+// How often the flusher writes out what was logged, in microseconds.
+const useconds_t LOG_FLUSH_INTERVAL = 10'000;
+// Records of one kind logged in one second, more are only counted.
+const uint32_t LOG_SAMPLE_LIMIT = 100;
+// Room of records which don't come from any room.
+const uint32_t NO_ROOM = UINT32_MAX;
+
+enum LogKind : uint8_t {
+  LOG_NEW_GAME = 0,           // a: width, b: height, c: number of names
+  LOG_PLAYER_NAME = 1,        // text: one name of the new game
+  LOG_NEW_GAME_ID = 2,        // a: game id
+  LOG_PLAYER_ELIMINATED = 3,  // a: player number
+  LOG_GAME_OVER = 4,
+  LOG_BAD_SIZE = 5,
+  LOG_BAD_NAME = 6,
+  LOG_SEND_WOULD_BLOCK = 7,
+  LOG_SEND_FAILED = 8,        // a: errno
+  LOG_INBOX_FULL = 9,
+  LOG_KINDS = 10
+};
+
+class LogRecord {
+public:
+  LogKind kind;
+  uint32_t room;
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  char text[PLAYER_NAME_MAX_LENGTH + 1];
+};
+
+// Log written to stderr in the background, so that rooms never wait for
+// the terminal. Logging only copies a record into a ring (any number of
+// threads can log at once, without locks); a flusher thread formats
+// the records and writes them out in big chunks. When the ring is full,
+// records are dropped and counted. Repetitive kinds of records (everything
+// but new games) are sampled: at most LOG_SAMPLE_LIMIT of them per second
+// are kept, the rest are only counted.
+class Logger {
+public:
+  Logger() : head(0), tail(0), dropped(0), running(false), showRooms(false),
+             lastSummary(0) {
+    for (size_t i = 0; i < LOG_RING_SIZE; ++i)
+      ring[i].seq.store(i, std::memory_order_relaxed);
+    for (size_t i = 0; i < LOG_KINDS; ++i) {
+      samples[i].second.store(0, std::memory_order_relaxed);
+      samples[i].count.store(0, std::memory_order_relaxed);
+      samples[i].suppressed.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // With withRooms, messages of rooms start with the number of the room.
+  void start(bool withRooms) {
+    showRooms = withRooms;
+    running = true;
+    flusher = std::thread(&Logger::run, this);
+  }
+
+  // The log of the server is a global, so it's destroyed by exit() (e.g.
+  // from syserr) while the flusher still runs; a joinable thread can't be
+  // destroyed.
+  ~Logger() {
+    if (!flusher.joinable())
+      return;
+    if (flusher.get_id() == std::this_thread::get_id())
+      flusher.detach();
+    else
+      stop();
+  }
+
+  // Writes out everything logged so far and stops the flusher.
+  void stop() {
+    if (!running)
+      return;
+    running = false;
+    flusher.join();
+    flush(true);
+  }
+
+  void log(LogKind kind, uint32_t room, uint32_t a = 0, uint32_t b = 0,
+           uint32_t c = 0, const std::string &text = std::string()) {
+    if (kind != LOG_NEW_GAME && kind != LOG_PLAYER_NAME && !sample(kind))
+      return;
+    uint64_t position = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &ring[position & (LOG_RING_SIZE - 1)];
+      uint64_t seq = slot->seq.load(std::memory_order_acquire);
+      if (seq == position) {
+        if (head.compare_exchange_weak(position, position + 1,
+                                       std::memory_order_relaxed))
+          break;
+      } else if (seq < position) {
+        // The flusher didn't free this slot yet, the ring is full.
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        position = head.load(std::memory_order_relaxed);
+      }
+    }
+    LogRecord &record = slot->record;
+    record.kind = kind;
+    record.room = room;
+    record.a = a;
+    record.b = b;
+    record.c = c;
+    size_t length = std::min(text.length(), (size_t) PLAYER_NAME_MAX_LENGTH);
+    memcpy(record.text, text.data(), length);
+    record.text[length] = 0;
+    slot->seq.store(position + 1, std::memory_order_release);
+  }
+
+private:
+  class Slot {
+  public:
+    // position + 1 once the record at position is written,
+    // position + LOG_RING_SIZE once it's read and the slot is free again.
+    std::atomic<uint64_t> seq;
+    LogRecord record;
+  };
+
+  class Sample {
+  public:
+    std::atomic<int64_t> second;
+    std::atomic<uint32_t> count;
+    std::atomic<uint64_t> suppressed;
+  };
+
+  // A "New game" line waiting for the names of the players.
+  class NewGameLine {
+  public:
+    std::string line;
+    uint32_t namesLeft;
+  };
+
+  // Returns false if too many records of this kind were logged this second.
+  bool sample(LogKind kind) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    Sample &s = samples[kind];
+    if (s.second.load(std::memory_order_relaxed) != ts.tv_sec) {
+      s.second.store(ts.tv_sec, std::memory_order_relaxed);
+      s.count.store(0, std::memory_order_relaxed);
+    }
+    if (s.count.fetch_add(1, std::memory_order_relaxed) < LOG_SAMPLE_LIMIT)
+      return true;
+    s.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  void run() {
+    while (running) {
+      usleep(LOG_FLUSH_INTERVAL);
+      flush(false);
+    }
+  }
+
+  // Formats all records written so far and writes them out at once.
+  // Records which weren't logged are summarised once per second.
+  void flush(bool last) {
+    buffer.clear();
+    while (true) {
+      Slot &slot = ring[tail & (LOG_RING_SIZE - 1)];
+      if (slot.seq.load(std::memory_order_acquire) != tail + 1)
+        break;
+      format(slot.record);
+      slot.seq.store(tail + LOG_RING_SIZE, std::memory_order_release);
+      ++tail;
+    }
+
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    if (last || ts.tv_sec != lastSummary) {
+      lastSummary = ts.tv_sec;
+      for (size_t i = 0; i < LOG_KINDS; ++i) {
+        uint64_t count =
+            samples[i].suppressed.exchange(0, std::memory_order_relaxed);
+        if (count > 0)
+          append("... %" PRIu64 " more \"%s\" messages not logged\n",
+                 count, NAMES[i]);
+      }
+      uint64_t count = dropped.exchange(0, std::memory_order_relaxed);
+      if (count > 0)
+        append("... log full, %" PRIu64 " messages dropped\n", count);
+    }
+
+    for (size_t done = 0; done < buffer.size(); ) {
+      ssize_t written = write(STDERR_FILENO, buffer.data() + done,
+                              buffer.size() - done);
+      if (written <= 0)
+        break;
+      done += written;
+    }
+  }
+
+  void format(const LogRecord &record) {
+    size_t lineStart = buffer.size();
+    if (showRooms && record.room != NO_ROOM
+        && record.kind != LOG_PLAYER_NAME)
+      append("Room %u: ", record.room);
+    switch (record.kind) {
+      case LOG_NEW_GAME:
+        append("New game: %u %u", record.a, record.b);
+        if (record.c == 0) {
+          append("\n");
+        } else {
+          // Names of the players come in the next records (maybe mixed with
+          // records of other rooms), the line is written after the last one.
+          NewGameLine &pending = newGames[record.room];
+          pending.line.assign(buffer, lineStart, std::string::npos);
+          pending.namesLeft = record.c;
+          buffer.resize(lineStart);
+        }
+        break;
+      case LOG_PLAYER_NAME: {
+        auto it = newGames.find(record.room);
+        if (it == newGames.end())
+          break;
+        it->second.line.append(" ").append(record.text);
+        if (--it->second.namesLeft == 0) {
+          buffer.append(it->second.line).append("\n");
+          newGames.erase(it);
+        }
+        break;
+      }
+      case LOG_NEW_GAME_ID:
+        append("New game id: %u\n", record.a);
+        break;
+      case LOG_PLAYER_ELIMINATED:
+        append("Player eliminated: %u\n", record.a);
+        break;
+      case LOG_GAME_OVER:
+        append("Game over\n");
+        break;
+      case LOG_BAD_SIZE:
+        append("Recieved datagram has incorrect size, ignoring.\n");
+        break;
+      case LOG_BAD_NAME:
+        append("Player name contains illegal character, ignoring.\n");
+        break;
+      case LOG_SEND_WOULD_BLOCK:
+        append("Sendto would block, attempting without flags.\n");
+        break;
+      case LOG_SEND_FAILED:
+        append("Sending events not successful.\nsendto (%u; %s)\n",
+               record.a, strerror((int) record.a));
+        break;
+      case LOG_INBOX_FULL:
+        append("Too many datagrams waiting for the room, ignoring.\n");
+        break;
+      default:
+        break;
+    }
+  }
+
+  void append(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (length > 0)
+      buffer.append(line, std::min((size_t) length, sizeof(line) - 1));
+  }
+
+  static constexpr const char *NAMES[LOG_KINDS] = {
+      "New game", "", "New game id", "Player eliminated", "Game over",
+      "incorrect size", "illegal character", "Sendto would block",
+      "Sending events not successful", "Too many datagrams waiting"};
+
+  Slot ring[LOG_RING_SIZE];
+  std::atomic<uint64_t> head;
+  uint64_t tail;  // only used by the flusher
+  std::atomic<uint64_t> dropped;
+  Sample samples[LOG_KINDS];
+  std::atomic<bool> running;
+  bool showRooms;
+  std::thread flusher;
+
+  // Used only by the flusher.
+  std::string buffer;
+  std::unordered_map<uint32_t, NewGameLine> newGames;
+  time_t lastSummary;
+};
+
+constexpr const char *Logger::NAMES[LOG_KINDS];
+
+#endif //ZADANIE2_LOGGER_H
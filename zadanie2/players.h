@@ -0,0 +1,209 @@
+#ifndef ZADANIE2_PLAYERS_H
+#define ZADANIE2_PLAYERS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+
+#include "siktacka.h"
+
+// Value of Player::snapshotChunk when the client doesn't want a snapshot.
+const uint32_t NO_SNAPSHOT_CHUNK = UINT32_MAX;
+
+class Snake {
+public:
+  uint8_t number; // players without snakes don't need a number
+  bool alive;
+  long double x;
+  long double y;
+  long double angle;
+  int turnDirection;  // -1: left, 0: straight, 1: right
+};
+
+class Player {
+public:
+  char name[PLAYER_NAME_MAX_LENGTH + 1];  // empty for observers
+  size_t nameLength;
+
+  bool ready;
+  bool hasSnake;
+  Snake snake;
+  uint64_t lastReceiveTime;
+  bool disconnected; // true when same client connects with a higher session ID
+
+  uint64_t sessionId;
+  uint32_t nextExpectedEvent;
+  uint32_t snapshotChunk;  // first chunk asked for, or NO_SNAPSHOT_CHUNK
+  in6_addr addr;
+  in_port_t port;
+
+  bool operator < (const Player &p) const {
+    int cmp = strcmp(name, p.name);
+    if (cmp == 0)
+      return sessionId < p.sessionId;
+    return cmp < 0;
+  }
+};
+
+// Name of a player, kept in the player (or in a datagram while looking for
+// its sender), so that looking it up doesn't copy it.
+class PlayerName {
+public:
+  const char *name;
+  size_t length;
+
+  bool operator == (const PlayerName &n) const {
+    return length == n.length && memcmp(name, n.name, length) == 0;
+  }
+};
+
+class PlayerNameHash {
+public:
+  size_t operator () (const PlayerName &n) const {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < n.length; ++i)
+      hash = (hash ^ (uint8_t) n.name[i]) * 1099511628211ULL;
+    return (size_t) hash;
+  }
+};
+
+// Socket of a client and the name it plays with. One socket can be used by
+// a few players, with different names.
+class ClientSocket {
+public:
+  in6_addr addr;
+  in_port_t port;
+  PlayerName name;
+
+  bool operator == (const ClientSocket &s) const {
+    return port == s.port && memcmp(&addr, &s.addr, sizeof(addr)) == 0
+           && name == s.name;
+  }
+};
+
+class ClientSocketHash {
+public:
+  size_t operator () (const ClientSocket &s) const {
+    uint64_t parts[2];
+    memcpy(parts, &s.addr, sizeof(parts));
+    return std::hash<uint64_t>()(parts[0] * 31 + parts[1] * 17 + s.port)
+           ^ PlayerNameHash()(s.name);
+  }
+};
+
+// All players and observers, in the order they are iterated in (players
+// are sorted by name between games, new ones are added at the end).
+// Players stay in the same place in memory for as long as they are kept.
+// Connected clients can be found by their socket and name, and the last
+// player added with a name by that name (even if disconnected, its name
+// stays taken for as long as it's kept), in constant time.
+class PlayerDirectory {
+public:
+  class iterator {
+  public:
+    iterator(std::vector<Player *>::iterator it) : it(it) {}
+    Player &operator * () const { return **it; }
+    Player *operator -> () const { return *it; }
+    iterator &operator ++ () { ++it; return *this; }
+    bool operator != (const iterator &i) const { return it != i.it; }
+    bool operator == (const iterator &i) const { return it == i.it; }
+
+  private:
+    friend class PlayerDirectory;
+    std::vector<Player *>::iterator it;
+  };
+
+  iterator begin() { return iterator(order.begin()); }
+  iterator end() { return iterator(order.end()); }
+
+  size_t size() const {
+    return order.size();
+  }
+
+  // Returns the connected client using this socket with this name, or NULL.
+  Player *find(const in6_addr &addr, in_port_t port, const char *name,
+               size_t length) {
+    auto it = bySocket.find(ClientSocket{addr, port, PlayerName{name, length}});
+    return it == bySocket.end() ? NULL : it->second;
+  }
+
+  // Returns the last player added with this (not empty) name, connected or
+  // not, or NULL if no player with this name is kept.
+  Player *findByName(const char *name, size_t length) {
+    auto it = byName.find(PlayerName{name, length});
+    return it == byName.end() ? NULL : it->second;
+  }
+
+  // Adds a connected client. No other connected client can use its socket
+  // with its name. It takes the name over from a player kept with it.
+  Player &add(const in6_addr &addr, in_port_t port,
+              const char *name, size_t nameLength, uint64_t sessionId) {
+    Player *player;
+    if (freeSlots.empty()) {
+      slots.emplace_back();
+      player = &slots.back();
+    } else {
+      player = freeSlots.back();
+      freeSlots.pop_back();
+    }
+    memcpy(player->name, name, nameLength);
+    player->name[nameLength] = 0;
+    player->nameLength = nameLength;
+    player->addr = addr;
+    player->port = port;
+    player->sessionId = sessionId;
+    player->disconnected = false;
+    order.push_back(player);
+    bySocket[socketOf(*player)] = player;
+    if (nameLength > 0)
+      byName[PlayerName{player->name, nameLength}] = player;
+    return *player;
+  }
+
+  // Marks a client as disconnected, it can't be found by its socket anymore.
+  void disconnect(Player &player) {
+    if (player.disconnected)
+      return;
+    player.disconnected = true;
+    bySocket.erase(socketOf(player));
+  }
+
+  // Removes a player, returns the iterator to the next one.
+  iterator erase(iterator position) {
+    Player *player = *position.it;
+    disconnect(*player);
+    if (player->nameLength > 0) {
+      auto it = byName.find(PlayerName{player->name, player->nameLength});
+      if (it != byName.end() && it->second == player)
+        byName.erase(it);
+    }
+    freeSlots.push_back(player);
+    return iterator(order.erase(position.it));
+  }
+
+  // Orders players by their names (and session IDs).
+  void sort() {
+    std::sort(order.begin(), order.end(),
+              [](const Player *a, const Player *b) { return *a < *b; });
+  }
+
+private:
+  static ClientSocket socketOf(const Player &player) {
+    return ClientSocket{player.addr, player.port,
+                        PlayerName{player.name, player.nameLength}};
+  }
+
+  std::deque<Player> slots;
+  std::vector<Player *> freeSlots;
+  std::vector<Player *> order;
+  std::unordered_map<ClientSocket, Player *, ClientSocketHash> bySocket;
+  std::unordered_map<PlayerName, Player *, PlayerNameHash> byName;
+};
+
+#endif //ZADANIE2_PLAYERS_H
@@ -0,0 +1,256 @@
+#ifndef ZADANIE2_ROOM_H
+#define ZADANIE2_ROOM_H
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "siktacka.h"
+#include "util.h"
+#include "logger.h"
+#include "events.h"
+#include "players.h"
+#include "scheduler.h"
+#include "game.h"
+#include "snapshot.h"
+
+// Number of datagrams sent with one sendmmsg.
+const size_t SEND_BATCH = 64;
+// Datagrams waiting for the next round of a room, more are dropped.
+const size_t INBOX_MAX_DATAGRAMS = 4096;
+
+// A datagram from a client waiting to be handled by its room.
+class ClientDatagram {
+public:
+  uint8_t data[sizeof(ClientToServerDatagram) + PLAYER_NAME_MAX_LENGTH];
+  size_t size;
+  sockaddr_in6 fromAddr;
+  uint64_t receiveTime;
+};
+
+// Datagrams waiting to be sent with one sendmmsg. Every datagram is made of
+// two parts (like the header and encoded events, which stay in the event
+// log), which mustn't change until the batch is flushed.
+class SendBatch {
+public:
+  SendBatch(int sock, Logger &log, uint32_t room)
+      : sock(sock), log(log), room(room), count(0) {}
+
+  void add(const Player &player, const void *first, size_t firstLength,
+           const void *second, size_t secondLength) {
+    sockaddr_in6 &toAddr = addrs[count];
+    memset(&toAddr, 0, sizeof(toAddr));
+    toAddr.sin6_family = AF_INET6;
+    toAddr.sin6_addr = player.addr;
+    toAddr.sin6_port = player.port;
+
+    iovec *iov = &iovecs[2 * count];
+    iov[0].iov_base = (void *) first;
+    iov[0].iov_len = firstLength;
+    iov[1].iov_base = (void *) second;
+    iov[1].iov_len = secondLength;
+
+    memset(&msgs[count], 0, sizeof(msgs[count]));
+    msgs[count].msg_hdr.msg_name = &toAddr;
+    msgs[count].msg_hdr.msg_namelen = sizeof(toAddr);
+    msgs[count].msg_hdr.msg_iov = iov;
+    msgs[count].msg_hdr.msg_iovlen = 2;
+    if (++count == SEND_BATCH)
+      flush();
+  }
+
+  void flush() {
+    size_t sent = 0;
+    while (sent < count) {
+      // Attempt to do a non-blocking send.
+      int ret = sendmmsg(sock, msgs + sent, (unsigned) (count - sent),
+                         MSG_DONTWAIT);
+      // If it would block, don't set the non-blocking flag.
+      if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        log.log(LOG_SEND_WOULD_BLOCK, room);
+        ret = sendmmsg(sock, msgs + sent, (unsigned) (count - sent), 0);
+      }
+      if (ret < 0) {
+        // This datagram can't be sent, skip it.
+        log.log(LOG_SEND_FAILED, room, (uint32_t) errno);
+        ret = 1;
+      }
+      if (DEBUG)
+        for (int i = 0; i < ret; ++i)
+          fprintf(stderr, "Sent %u bytes to port %u\n",
+                  msgs[sent + i].msg_len, ntohs(addrs[sent + i].sin6_port));
+      sent += ret;
+    }
+    count = 0;
+  }
+
+private:
+  int sock;
+  Logger &log;
+  uint32_t room;
+  mmsghdr msgs[SEND_BATCH];
+  iovec iovecs[2 * SEND_BATCH];
+  sockaddr_in6 addrs[SEND_BATCH];
+  size_t count;
+};
+
+// A game served to its clients over the network. Datagrams of its clients
+// are delivered to it by the thread receiving them, and are handled at the
+// start of the next round. Rounds are run by one worker
+// thread at a time.
+class Room {
+public:
+  Room(const GameConfig &config, uint32_t number, uint32_t seed, int sock,
+       Logger &log, uint64_t start)
+      : number(number), sock(sock), log(log),
+        schedule(config.roundsPerSec, start),
+        game(config, number, seed, log),
+        snapshots(config.snapshotInterval > 0),
+        snapshot(config.snapshotInterval) {}
+
+  // Called by the thread receiving datagrams. When clients send much more
+  // than a round can handle, the rest is dropped, so a flood can't make the
+  // room take all the memory.
+  void deliver(const uint8_t *data, size_t size, const sockaddr_in6 &fromAddr,
+               uint64_t receiveTime) {
+    std::lock_guard<std::mutex> lock(inboxMutex);
+    if (inbox.size() >= INBOX_MAX_DATAGRAMS) {
+      log.log(LOG_INBOX_FULL, number);
+      return;
+    }
+    inbox.emplace_back();
+    ClientDatagram &datagram = inbox.back();
+    memcpy(datagram.data, data, size);
+    datagram.size = size;
+    datagram.fromAddr = fromAddr;
+    datagram.receiveTime = receiveTime;
+  }
+
+  TickSchedule &roundSchedule() {
+    return schedule;
+  }
+
+  // Handles datagrams delivered since the last round, simulates a turn
+  // and sends new events.
+  void round() {
+    {
+      std::lock_guard<std::mutex> lock(inboxMutex);
+      inbox.swap(received);
+    }
+    for (const ClientDatagram &datagram : received)
+      game.handleDatagram(datagram.data, datagram.size, datagram.fromAddr,
+                          datagram.receiveTime);
+    received.clear();
+
+    game.round(getMonotonicTime());
+    if (snapshots)
+      snapshot.follow(game.gameEvents());
+    sendEvents();
+  }
+
+private:
+  void printEvents(size_t first, size_t end) {
+    const EventLog &events = game.gameEvents();
+    for (size_t i = first; i < end; ++i) {
+      Event event = events[i];
+      fprintf(stderr, "Event %zu - ", i);
+      switch (event.eventType) {
+        case NEW_GAME:
+          fprintf(stderr, "new game %u %u", event.x, event.y);
+          for (size_t j = 0; j < events.names().length();
+               j += strlen(&events.names()[j]) + 1)
+            fprintf(stderr, " %s", &events.names()[j]);
+          fprintf(stderr, "\n");
+          break;
+        case PIXEL:
+          fprintf(stderr, "pixel %u %u %u\n",
+                  event.playerNumber, event.x, event.y);
+          break;
+        case PLAYER_ELIMINATED:
+          fprintf(stderr, "player eliminated %u\n", event.playerNumber);
+          break;
+        case GAME_OVER:
+          fprintf(stderr, "game over\n");
+          break;
+      }
+    }
+  }
+
+  // Send events to all players/observers according to their
+  // nextExpectedEvent, in as many datagrams as needed.
+  void sendEvents() {
+    ServerToClientDatagramHeader header;
+    header.gameId = htonl(game.id());
+    const EventLog &events = game.gameEvents();
+    SendBatch batch(sock, log, number);
+    // The snapshot is prepared once, it can't change while it's being sent.
+    bool snapshotPrepared = false, snapshotReady = false;
+    for (Player &player : game.allPlayers()) {
+      if (player.disconnected)
+        continue;
+
+      if (player.snapshotChunk != NO_SNAPSHOT_CHUNK) {
+        uint32_t chunk = player.snapshotChunk;
+        player.snapshotChunk = NO_SNAPSHOT_CHUNK;
+        if (snapshots && !snapshotPrepared) {
+          snapshotReady = snapshot.prepare(game.id(), chunk == 0);
+          snapshotPrepared = true;
+        }
+        if (snapshotReady) {
+          // Send the next chunks of the snapshot instead of the events
+          // before it.
+          uint32_t end =
+              std::min(snapshot.chunkCount(), chunk + SNAPSHOT_WINDOW);
+          for (; chunk < end; ++chunk)
+            batch.add(player, snapshot.datagram(chunk),
+                      snapshot.datagramLength(chunk), NULL, 0);
+          player.nextExpectedEvent = (uint32_t) events.size();
+          continue;
+        }
+      }
+
+      if (player.nextExpectedEvent >= events.size())
+        // Nothing to send.
+        continue;
+
+      if (DEBUG)
+        fprintf(stderr, "Sending events to player: %d %s\n",
+                player.hasSnake ? player.snake.number : -1,
+                player.name);
+
+      while (player.nextExpectedEvent < events.size()) {
+        // Events from nextExpectedEvent that fit in one datagram.
+        size_t first = player.nextExpectedEvent;
+        size_t end = events.datagramEnd(first);
+        if (DEBUG)
+          printEvents(first, end);
+        batch.add(player, &header, sizeof(header), events.encoded(first),
+                  events.encodedLength(first, end));
+        player.nextExpectedEvent = (uint32_t) end;
+      }
+    }
+    batch.flush();
+  }
+
+  uint32_t number;
+  int sock;
+  Logger &log;
+  TickSchedule schedule;
+  Game game;
+  bool snapshots;
+  BoardSnapshot snapshot;
+
+  std::mutex inboxMutex;
+  std::vector<ClientDatagram> inbox;  // delivered, guarded by inboxMutex
+  std::vector<ClientDatagram> received;  // being handled
+};
+
+#endif //ZADANIE2_ROOM_H
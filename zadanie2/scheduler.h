@@ -0,0 +1,138 @@
+#ifndef ZADANIE2_SCHEDULER_H
+#define ZADANIE2_SCHEDULER_H
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// Rounds run back to back to catch up after the server was late. If it's
+// later than that, the missed rounds are skipped, so that the game is never
+// sped up for longer than that.
+const uint64_t MAX_CATCH_UP_TICKS = 3;
+// Buckets of the lateness histogram: below 1 us, below 2 us, below 4 us, ...
+const size_t LATENESS_BUCKETS = 24;
+
+// Decides when rounds should run, on the monotonic clock. Round n is due at
+// start + n / ticksPerSec seconds, so rounds don't drift. Remembers how late
+// every round was run.
+class TickSchedule {
+public:
+  TickSchedule(uint32_t ticksPerSec, uint64_t start)
+      : ticksPerSec(ticksPerSec), start(start), tick(0),
+        ticks(0), skipped(0), maxLateness(0) {
+    for (size_t i = 0; i < LATENESS_BUCKETS; ++i)
+      lateness[i] = 0;
+  }
+
+  // Monotonic time (in microseconds) when the next round is due.
+  uint64_t nextTickTime() const {
+    return start + tick * 1'000'000 / ticksPerSec;
+  }
+
+  // Returns true if a round should be run now, and counts it as run.
+  bool tickDue() {
+    return tickDue(getMonotonicTime());
+  }
+
+  // Returns true if a round should be run at currentTime, and counts it
+  // as run.
+  bool tickDue(uint64_t currentTime) {
+    uint64_t due = nextTickTime();
+    if (currentTime < due)
+      return false;
+
+    uint64_t late = currentTime - due;
+    size_t bucket = 0;
+    while (bucket + 1 < LATENESS_BUCKETS && (late >> bucket) > 0)
+      ++bucket;
+    ++lateness[bucket];
+    if (late > maxLateness)
+      maxLateness = late;
+    ++ticks;
+
+    ++tick;
+    // Rounds which are due by now (rounded like in nextTickTime), other
+    // than this one.
+    uint64_t dueTicks =
+        ((currentTime - start + 1) * ticksPerSec - 1) / 1'000'000 + 1;
+    if (dueTicks > tick + MAX_CATCH_UP_TICKS) {
+      uint64_t behind = dueTicks - tick;
+      skipped += behind - MAX_CATCH_UP_TICKS;
+      tick += behind - MAX_CATCH_UP_TICKS;
+    }
+    return true;
+  }
+
+  uint64_t skippedTicks() const {
+    return skipped;
+  }
+
+  // Adds statistics of another schedule to this one.
+  void merge(const TickSchedule &other) {
+    ticks += other.ticks;
+    skipped += other.skipped;
+    if (other.maxLateness > maxLateness)
+      maxLateness = other.maxLateness;
+    for (size_t i = 0; i < LATENESS_BUCKETS; ++i)
+      lateness[i] += other.lateness[i];
+  }
+
+  void printStats(FILE *file) const {
+    fprintf(file, "Rounds: %" PRIu64 ", skipped: %" PRIu64
+            ", max lateness: %" PRIu64 " us\nLateness:", ticks, skipped,
+            maxLateness);
+    for (size_t i = 0; i < LATENESS_BUCKETS; ++i)
+      if (lateness[i] > 0)
+        fprintf(file, " <%" PRIu64 "us: %" PRIu64, ((uint64_t) 1) << i,
+                lateness[i]);
+    fprintf(file, "\n");
+  }
+
+private:
+  uint32_t ticksPerSec;
+  uint64_t start;
+  uint64_t tick;  // number of the next round
+
+  uint64_t ticks;
+  uint64_t skipped;
+  uint64_t maxLateness;
+  uint64_t lateness[LATENESS_BUCKETS];
+};
+
+// Timer on the monotonic clock, precise to a microsecond.
+class Timer {
+public:
+  Timer() {
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    checkSysError(fd, "timerfd_create");
+  }
+
+  ~Timer() {
+    close(fd);
+  }
+
+  // Waits until the given monotonic time (in microseconds).
+  void waitUntil(uint64_t time) {
+    if (time <= getMonotonicTime())
+      return;
+    itimerspec spec;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+    spec.it_value.tv_sec = time / 1'000'000;
+    spec.it_value.tv_nsec = (time % 1'000'000) * 1000;
+    checkSysError(timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL),
+                  "timerfd_settime");
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EINTR)
+      checkNonFatal(-1, "read timerfd");
+  }
+
+private:
+  int fd;
+};
+
+#endif //ZADANIE2_SCHEDULER_H
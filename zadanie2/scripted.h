@@ -0,0 +1,112 @@
+#ifndef ZADANIE2_SCRIPTED_H
+#define ZADANIE2_SCRIPTED_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <netinet/in.h>
+#include <zlib.h>
+
+#include "siktacka.h"
+#include "logger.h"
+#include "game.h"
+
+// A player played by a script instead of a client. It sends a datagram
+// before every round, like a real client would; it keeps turning one way
+// for a while, then goes straight or turns the other way, as chosen by its
+// own generator.
+class ScriptedPlayer {
+public:
+  uint8_t datagram[sizeof(ClientToServerDatagram) + PLAYER_NAME_MAX_LENGTH];
+  size_t size;
+  sockaddr_in6 addr;
+  uint32_t random;
+  uint32_t roundsLeft;  // until the direction changes
+  int8_t turnDirection;
+
+  // Chooses the direction for the next round.
+  void step() {
+    if (roundsLeft == 0) {
+      random = random * 1103515245 + 12345;
+      turnDirection = (int8_t) ((random >> 16) % 3) - 1;
+      roundsLeft = 1 + (random >> 8) % 64;
+    }
+    --roundsLeft;
+  }
+};
+
+// Seeded games between scripted players, without sockets and without
+// waiting for rounds. The same config, players and seed always give the same
+// games, so the checksum of their events shows if the engine changed them.
+class ScriptedGames {
+public:
+  ScriptedGames(const GameConfig &config, uint32_t playerCount, uint32_t seed,
+                Logger &log)
+      : game(config, 0, seed, log), rounds(0), events(0), gamesPlayed(0),
+        checksum(crc32(0L, Z_NULL, 0)), currentTime(0),
+        roundTime(1'000'000 / config.roundsPerSec), wasInProgress(false),
+        players(playerCount) {
+    for (uint32_t i = 0; i < playerCount; ++i) {
+      ScriptedPlayer &p = players[i];
+      char name[PLAYER_NAME_MAX_LENGTH + 1];
+      int nameLength = snprintf(name, sizeof(name), "p%05u", i);
+      ClientToServerDatagram *datagram = (ClientToServerDatagram *) p.datagram;
+      datagram->sessionId = htobe64(1);
+      memcpy(datagram->playerName, name, (size_t) nameLength);
+      p.size = sizeof(ClientToServerDatagram) + nameLength;
+      memset(&p.addr, 0, sizeof(p.addr));
+      p.addr.sin6_family = AF_INET6;
+      // Every player has its own address.
+      uint32_t address = htonl(i + 1);
+      memcpy(&p.addr.sin6_addr.s6_addr[12], &address, sizeof(address));
+      p.addr.sin6_port = htons(1);
+      p.random = seed + i;
+      p.roundsLeft = 0;
+    }
+  }
+
+  // Every player sends its datagram, then one round is played.
+  void round() {
+    const EventLog &gameEvents = game.gameEvents();
+    for (ScriptedPlayer &p : players) {
+      p.step();
+      ClientToServerDatagram *datagram = (ClientToServerDatagram *) p.datagram;
+      datagram->turnDirection = p.turnDirection;
+      datagram->nextExpectedEventNumer = htonl((uint32_t) gameEvents.size());
+      game.handleDatagram(p.datagram, p.size, p.addr, currentTime);
+    }
+
+    size_t eventsBefore = wasInProgress ? gameEvents.size() : 0;
+    game.round(currentTime);
+    ++rounds;
+    currentTime += roundTime;
+
+    if (game.inProgress() || wasInProgress) {
+      size_t eventsAfter = gameEvents.size();
+      if (eventsAfter > eventsBefore) {
+        checksum = crc32(checksum, gameEvents.encoded(eventsBefore),
+                         (uInt) gameEvents.encodedLength(eventsBefore,
+                                                         eventsAfter));
+        events += eventsAfter - eventsBefore;
+      }
+    }
+    if (wasInProgress && !game.inProgress())
+      ++gamesPlayed;
+    wasInProgress = game.inProgress();
+  }
+
+  Game game;
+  uint64_t rounds;
+  uint64_t events;  // of games in progress
+  uint32_t gamesPlayed;
+  uLong checksum;  // of events of games in progress
+
+private:
+  uint64_t currentTime;
+  uint64_t roundTime;
+  bool wasInProgress;
+  std::vector<ScriptedPlayer> players;
+};
+
+#endif //ZADANIE2_SCRIPTED_H
@@ -1,6 +1,7 @@
 #ifndef ZADANIE2_SIKTACKA_H
 #define ZADANIE2_SIKTACKA_H
 
+#include <cstddef>
 #include <cstdint>
 
 const int MAX_DATAGRAM_SIZE = 512;
@@ -57,4 +58,51 @@ struct __attribute__((__packed__)) PlayerEliminatedEventData {
   uint8_t playerNumber;
 };
 
+// Snapshots (an extension, only used by clients which ask for it).
+// Instead of replaying all events of a game, a client joining in the middle
+// of it can download a snapshot of the game at some event, and then only
+// the events after it. A client asks for a snapshot by sending
+// SNAPSHOT_REQUEST | n as the next expected event number, where n is
+// the first chunk of the snapshot it's missing. The server answers with
+// datagrams of chunks from n on. If it has no snapshot, it sends events
+// from 0 as usual.
+
+const uint32_t SNAPSHOT_REQUEST = 0x80000000;
+// Put instead of the length of the first event in datagrams with a chunk
+// of a snapshot.
+const uint32_t SNAPSHOT_MARKER = 0xffffffff;
+
+struct __attribute__((__packed__)) SnapshotChunkHeader {
+  uint32_t marker;
+  uint32_t eventNumber;  // the snapshot includes events before this one
+  uint32_t length;  // of the whole compressed snapshot
+  uint32_t rawLength;  // of the snapshot after decompression
+  uint32_t offset;  // of this chunk
+  // data
+  // crc32 (of the chunk header and data)
+};
+
+// Data of a snapshot in every datagram but the last one.
+const size_t SNAPSHOT_CHUNK_LENGTH =
+    MAX_DATAGRAM_SIZE - sizeof(ServerToClientDatagramHeader)
+    - sizeof(SnapshotChunkHeader) - sizeof(uint32_t);
+
+// Beginning of a decompressed snapshot.
+struct __attribute__((__packed__)) SnapshotHeader {
+  uint32_t width;
+  uint32_t height;
+  uint32_t playerCount;
+  uint32_t namesLength;
+  // SnapshotPlayer for each player
+  // player names, as in NEW_GAME
+  // width * height bytes, row by row: 0 for a free pixel, 1 + number
+  // of the player for a taken one
+};
+
+struct __attribute__((__packed__)) SnapshotPlayer {
+  uint8_t eliminated;
+  uint32_t headX;  // last pixel of the player
+  uint32_t headY;
+};
+
 #endif //ZADANIE2_SIKTACKA_H
@@ -0,0 +1,177 @@
+#ifndef ZADANIE2_SNAPSHOT_H
+#define ZADANIE2_SNAPSHOT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <zlib.h>
+
+#include "siktacka.h"
+#include "events.h"
+
+// Boards with more pixels can't have snapshots, their images would take
+// too much memory.
+const uint64_t SNAPSHOT_MAX_PIXELS = 1 << 24;
+// Chunks of a snapshot sent to a client in one round.
+const uint32_t SNAPSHOT_WINDOW = 16;
+
+// Snapshot of the current game, for clients joining in the middle of it.
+// The image of the board (who took every pixel) and the state of the
+// players follow the events of the game as they're logged. The snapshot is
+// only compressed and split into datagrams when a client asks for it, so
+// games nobody joins cost just the image. Games with fewer than interval
+// events don't have snapshots (replaying them is cheap), and a snapshot is
+// replaced when a client starts downloading it and it's older than interval
+// events, so that the events after it stay few.
+class BoardSnapshot {
+public:
+  explicit BoardSnapshot(uint32_t interval)
+      : interval(interval), game(0), applied(0), width(0), height(0),
+        built(false), eventNumber(0) {}
+
+  // Applies the events logged since the last call.
+  void follow(const EventLog &events) {
+    if (events.games() != game) {
+      game = events.games();
+      applied = 0;
+      built = false;
+    }
+    for (; applied < events.size(); ++applied)
+      apply(events[applied], events);
+  }
+
+  // Makes sure there's a snapshot of the current game (with this id) to send.
+  // A new snapshot is made if there's none, or if the last one is old and
+  // a client starts downloading it. Returns false if there's no snapshot.
+  bool prepare(uint32_t gameId, bool starting) {
+    if (applied < interval)
+      return false;
+    if (!built || (starting && applied - eventNumber >= interval))
+      build(gameId);
+    return built;
+  }
+
+  uint32_t chunkCount() const {
+    return (uint32_t) lengths.size();
+  }
+
+  // Datagram with a chunk of the snapshot, ready to be sent.
+  const uint8_t *datagram(uint32_t chunk) const {
+    return &datagrams[chunk * MAX_DATAGRAM_SIZE];
+  }
+
+  size_t datagramLength(uint32_t chunk) const {
+    return lengths[chunk];
+  }
+
+private:
+  void apply(const Event &event, const EventLog &events) {
+    switch (event.eventType) {
+      case NEW_GAME:
+        width = event.x;
+        height = event.y;
+        image.assign((size_t) width * height, 0);
+        names = events.names();
+        players.clear();
+        for (size_t i = 0; i < names.length(); i += strlen(&names[i]) + 1)
+          players.push_back(SnapshotPlayer{0, 0, 0});
+        break;
+      case PIXEL:
+        image[(size_t) event.y * width + event.x] =
+            (uint8_t) (event.playerNumber + 1);
+        players[event.playerNumber].headX = event.x;
+        players[event.playerNumber].headY = event.y;
+        break;
+      case PLAYER_ELIMINATED:
+        players[event.playerNumber].eliminated = 1;
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Compresses the game as it is now and splits it into datagrams.
+  void build(uint32_t gameId) {
+    built = false;
+    raw.clear();
+    SnapshotHeader header;
+    header.width = htonl(width);
+    header.height = htonl(height);
+    header.playerCount = htonl((uint32_t) players.size());
+    header.namesLength = htonl((uint32_t) names.length());
+    append(&header, sizeof(header));
+    for (const SnapshotPlayer &p : players) {
+      SnapshotPlayer player;
+      player.eliminated = p.eliminated;
+      player.headX = htonl(p.headX);
+      player.headY = htonl(p.headY);
+      append(&player, sizeof(player));
+    }
+    append(names.data(), names.length());
+    append(image.data(), image.size());
+
+    uLongf length = compressBound((uLong) raw.size());
+    compressed.resize(length);
+    if (compress2(compressed.data(), &length, raw.data(), (uLong) raw.size(),
+                  Z_BEST_SPEED) != Z_OK)
+      return;
+
+    size_t chunks =
+        (length + SNAPSHOT_CHUNK_LENGTH - 1) / SNAPSHOT_CHUNK_LENGTH;
+    datagrams.resize(chunks * MAX_DATAGRAM_SIZE);
+    lengths.resize(chunks);
+    for (size_t i = 0; i < chunks; ++i) {
+      size_t offset = i * SNAPSHOT_CHUNK_LENGTH;
+      size_t dataLength = std::min(SNAPSHOT_CHUNK_LENGTH, length - offset);
+      uint8_t *datagram = &datagrams[i * MAX_DATAGRAM_SIZE];
+      ServerToClientDatagramHeader *datagramHeader =
+          (ServerToClientDatagramHeader *) datagram;
+      datagramHeader->gameId = htonl(gameId);
+      SnapshotChunkHeader *chunk =
+          (SnapshotChunkHeader *) (datagramHeader + 1);
+      chunk->marker = htonl(SNAPSHOT_MARKER);
+      chunk->eventNumber = htonl((uint32_t) applied);
+      chunk->length = htonl((uint32_t) length);
+      chunk->rawLength = htonl((uint32_t) raw.size());
+      chunk->offset = htonl((uint32_t) offset);
+      memcpy(chunk + 1, &compressed[offset], dataLength);
+      size_t crcLength = sizeof(SnapshotChunkHeader) + dataLength;
+      uint32_t crc = htonl((uint32_t) crc32(0, (uint8_t *) chunk,
+                                            (uInt) crcLength));
+      memcpy((uint8_t *) chunk + crcLength, &crc, sizeof(crc));
+      lengths[i] = sizeof(ServerToClientDatagramHeader) + crcLength
+                   + sizeof(crc);
+    }
+    eventNumber = applied;
+    built = true;
+  }
+
+  void append(const void *data, size_t length) {
+    raw.insert(raw.end(), (const uint8_t *) data,
+               (const uint8_t *) data + length);
+  }
+
+  uint32_t interval;
+
+  // State of the game after the events applied so far.
+  uint64_t game;  // number of the game in the log
+  size_t applied;
+  uint32_t width;
+  uint32_t height;
+  std::vector<uint8_t> image;
+  std::string names;
+  std::vector<SnapshotPlayer> players;  // in host byte order
+
+  // The last snapshot.
+  bool built;
+  size_t eventNumber;
+  std::vector<uint8_t> raw;
+  std::vector<uint8_t> compressed;
+  std::vector<uint8_t> datagrams;  // one every MAX_DATAGRAM_SIZE bytes
+  std::vector<size_t> lengths;
+};
+
+#endif //ZADANIE2_SNAPSHOT_H
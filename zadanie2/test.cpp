@@ -0,0 +1,255 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cinttypes>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <netinet/in.h>
+#include <zlib.h>
+
+#include "siktacka.h"
+#include "util.h"
+#include "logger.h"
+#include "directions.h"
+#include "game.h"
+#include "scheduler.h"
+#include "scripted.h"
+
+using namespace std;
+
+// Checks that the table of directions doesn't change the games: every entry
+// must be bit for bit what cos and sin give for its angle (as the engine
+// computed them before the table), and seeded games must give the same
+// events as before. Also checks the schedule of rounds with rates which
+// don't divide a second, and which datagrams make new players. Exits with
+// EXIT_FAILURE if anything fails.
+
+uint32_t failures = 0;
+
+bool sameBits(long double a, long double b) {
+  // Only the first 10 bytes of a long double hold its value.
+  return memcmp(&a, &b, 10) == 0;
+}
+
+void checkDirection(long double angle) {
+  Direction direction = directions.get(angle);
+  long double dx = std::cos(angle * M_PIl / 180.0);
+  long double dy = std::sin(angle * M_PIl / 180.0);
+  if (!sameBits(direction.dx, dx) || !sameBits(direction.dy, dy)) {
+    if (++failures <= 10)
+      printf("Direction of angle %.3Lf differs: (%.21Lg, %.21Lg) instead of"
+             " (%.21Lg, %.21Lg)\n", angle, direction.dx, direction.dy, dx, dy);
+  }
+}
+
+// All angles in the table, and some around and outside it, which are
+// computed when needed.
+void checkTable() {
+  for (int64_t angle = -DIRECTION_TABLE_RANGE;
+       angle < DIRECTION_TABLE_RANGE; ++angle)
+    checkDirection((long double) angle);
+  for (int64_t angle = DIRECTION_TABLE_RANGE - 2;
+       angle < DIRECTION_TABLE_RANGE + 720; ++angle) {
+    checkDirection((long double) angle);
+    checkDirection((long double) -angle);
+  }
+  for (long double angle = -360.5; angle < 360; angle += 0.25)
+    checkDirection(angle);
+}
+
+// Games played by scripted players, like in the benchmark, and the checksum
+// of their events when the engine computed every direction with cos and sin.
+// Snakes of the last cases turn by almost a full turn every round, so their
+// angles soon leave the table.
+class GameCase {
+public:
+  uint32_t players;
+  uint32_t games;
+  uint32_t seed;
+  GameConfig config;
+  uLong checksum;
+};
+
+const GameCase GAME_CASES[] = {
+    {8, 10, 42, {800, 600, 50, 6, 0}, 0xe2d3c044},
+    {8, 200, 42, {800, 600, 50, 6, 0}, 0x089d5158},
+    {8, 5, 42, {800, 600, 50, 90, 0}, 0xdb8ab9b4},
+    {3, 20, 42, {70, 50, 50, 3, 0}, 0xf7389994},
+    {2, 2, 7, {2000, 2000, 50, 1, 0}, 0x180369b4},
+    {16, 5, 123, {800, 600, 50, 17, 0}, 0x9427e0f3},
+    {2, 100, 7, {4000, 4000, 50, 719, 0}, 0xd849f786},
+    {4, 20, 99, {2000, 2000, 50, 361, 0}, 0x71409e8b},
+};
+
+// The biggest angle (in either direction) any snake had.
+long double maxAngle = 0;
+
+// Plays the games of a case and returns the checksum of their events.
+uLong playGames(const GameCase &gameCase) {
+  // Never started, so nothing is written.
+  Logger log;
+  ScriptedGames games(gameCase.config, gameCase.players, gameCase.seed, log);
+  while (games.gamesPlayed < gameCase.games) {
+    games.round();
+    for (const Player &player : games.game.allPlayers())
+      if (player.hasSnake)
+        maxAngle = std::max(maxAngle, std::fabs(player.snake.angle));
+  }
+  return games.checksum;
+}
+
+// Runs rounds of a schedule exactly when they're due, then once late by
+// the given number of rounds, and checks which rounds were skipped.
+void checkSchedule(uint32_t ticksPerSec, uint64_t lateTicks) {
+  const uint64_t start = 1000, rounds = 1000;
+  TickSchedule schedule(ticksPerSec, start);
+  uint64_t last = 0;
+  for (uint64_t i = 0; i < rounds; ++i) {
+    uint64_t due = schedule.nextTickTime();
+    if (due != start + i * 1'000'000 / ticksPerSec || due < last
+        || !schedule.tickDue(due) || schedule.skippedTicks() != 0) {
+      ++failures;
+      printf("Round %" PRIu64 " at %u rounds/s: due at %" PRIu64 ", skipped"
+             " %" PRIu64 "\n", i, ticksPerSec, due, schedule.skippedTicks());
+      return;
+    }
+    last = due;
+  }
+
+  // Rounds up to rounds + lateTicks are due, only MAX_CATCH_UP_TICKS of the
+  // late ones are run.
+  uint64_t now = start + (rounds + lateTicks) * 1'000'000 / ticksPerSec;
+  uint64_t run = 0;
+  while (schedule.tickDue(now))
+    ++run;
+  uint64_t expectedSkipped =
+      lateTicks > MAX_CATCH_UP_TICKS ? lateTicks - MAX_CATCH_UP_TICKS : 0;
+  if (run != lateTicks + 1 - expectedSkipped
+      || schedule.skippedTicks() != expectedSkipped) {
+    ++failures;
+    printf("%" PRIu64 " rounds late at %u rounds/s: %" PRIu64 " run, %" PRIu64
+           " skipped\n", lateTicks, ticksPerSec, run,
+           schedule.skippedTicks());
+  }
+}
+
+// Sends a datagram to the game from the client at port (on ::1).
+void sendAs(Game &game, uint16_t port, const char *name, uint64_t sessionId,
+            int8_t turnDirection, uint64_t time) {
+  uint8_t data[sizeof(ClientToServerDatagram) + PLAYER_NAME_MAX_LENGTH];
+  ClientToServerDatagram *datagram = (ClientToServerDatagram *) data;
+  datagram->sessionId = htobe64(sessionId);
+  datagram->turnDirection = turnDirection;
+  datagram->nextExpectedEventNumer = 0;
+  size_t nameLength = strlen(name);
+  memcpy(datagram->playerName, name, nameLength);
+  sockaddr_in6 addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_loopback;
+  addr.sin6_port = htons(port);
+  game.handleDatagram(data, sizeof(ClientToServerDatagram) + nameLength, addr,
+                      time);
+}
+
+// Number of players with this name, and how many of them are connected.
+void countPlayers(Game &game, const char *name, uint32_t &all,
+                  uint32_t &connected) {
+  all = connected = 0;
+  for (Player &player : game.allPlayers()) {
+    if (strcmp(player.name, name) == 0) {
+      ++all;
+      if (!player.disconnected)
+        ++connected;
+    }
+  }
+}
+
+void checkPlayer(Game &game, const char *name, uint32_t all,
+                 uint32_t connected, const char *when) {
+  uint32_t allCount, connectedCount;
+  countPlayers(game, name, allCount, connectedCount);
+  if (allCount != all || connectedCount != connected) {
+    ++failures;
+    printf("%s: %u players named %s (%u connected) instead of %u (%u)\n",
+           when, allCount, name, connectedCount, all, connected);
+  }
+}
+
+// Names stay taken by disconnected players while their snakes are in the
+// game, and a client sending another name joins as another player.
+void checkPlayers() {
+  Logger log;
+  GameConfig config = {2000, 2000, 50, 1, 0};
+  Game game(config, 0, 1, log);
+
+  sendAs(game, 1, "a", 1, 1, 0);
+  sendAs(game, 1, "c", 1, 1, 0);
+  checkPlayer(game, "a", 1, 1, "Socket with two names");
+  checkPlayer(game, "c", 1, 1, "Socket with two names");
+  sendAs(game, 2, "b", 1, 1, 0);
+  sendAs(game, 3, "b", 1, 1, 0);
+  checkPlayer(game, "b", 1, 1, "Name of a connected player");
+  game.round(0);
+  if (!game.inProgress()) {
+    ++failures;
+    printf("Game of ready players didn't start\n");
+    return;
+  }
+
+  // Only a and c are still active, b is disconnected but keeps its snake.
+  uint64_t later = 3'000'000;
+  sendAs(game, 1, "a", 1, 1, later);
+  sendAs(game, 1, "c", 1, 1, later);
+  game.round(later);
+  if (!game.inProgress()) {
+    ++failures;
+    printf("Game ended too early\n");
+    return;
+  }
+  checkPlayer(game, "b", 1, 0, "Inactive player");
+  sendAs(game, 3, "b", 1, 0, later);
+  checkPlayer(game, "b", 1, 0, "Name of a disconnected player");
+
+  // The same client with a higher session ID replaces its player.
+  sendAs(game, 1, "a", 2, 0, later);
+  sendAs(game, 1, "a", 2, 0, later);
+  checkPlayer(game, "a", 2, 1, "Higher session ID");
+  sendAs(game, 4, "a", 3, 0, later);
+  checkPlayer(game, "a", 2, 1, "Name of a replaced player");
+}
+
+int main() {
+  checkTable();
+  if (failures > 0)
+    printf("%u directions differ\n", failures);
+
+  for (const GameCase &gameCase : GAME_CASES) {
+    uLong checksum = playGames(gameCase);
+    if (checksum != gameCase.checksum) {
+      ++failures;
+      printf("Games of %u players (%ux%u, turning speed %u, seed %u) have"
+             " checksum %08lx instead of %08lx\n", gameCase.players,
+             gameCase.config.width, gameCase.config.height,
+             gameCase.config.turningSpeed, gameCase.seed, checksum,
+             gameCase.checksum);
+    }
+  }
+
+  if (maxAngle < DIRECTION_TABLE_RANGE) {
+    ++failures;
+    printf("No snake turned outside the table (max. angle %.0Lf)\n", maxAngle);
+  }
+
+  checkPlayers();
+
+  for (uint32_t ticksPerSec : {3, 7, 50, 300, 999'999})
+    for (uint64_t lateTicks : {0, 1, 3, 4, 100})
+      checkSchedule(ticksPerSec, lateTicks);
+
+  if (failures > 0)
+    exit(EXIT_FAILURE);
+  printf("OK\n");
+  exit(EXIT_SUCCESS);
+}
@@ -7,6 +7,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 
 
 // Zwraca aktualny czas w mikrosekundach.
@@ -16,6 +17,13 @@ uint64_t getCurrentTime() {
   return ((uint64_t) tv.tv_sec) * 1'000'000 + ((uint64_t) tv.tv_usec);
 }
 
+// Zwraca czas monotoniczny (niezależny od zmian zegara) w mikrosekundach.
+uint64_t getMonotonicTime() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1'000'000 + ((uint64_t) ts.tv_nsec) / 1000;
+}
+
 // Wypisuje informację o błędnym zakończeniu funkcji systemowej
 // i kończy działanie programu.
 void syserr(const char *fmt, ...) {